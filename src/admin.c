@@ -288,13 +288,9 @@ void admin_send_response(xmlDocPtr     doc,
             xmlFree(buff);
             return;
         } else if (buf_len < (size_t)(len + ret + 64)) {
-            void *new_data;
             buf_len = ret + len + 64;
-            new_data = realloc(client->refbuf->data, buf_len);
-            if (new_data) {
+            if (refbuf_resize(client->refbuf, buf_len) == 0) {
                 ICECAST_LOG_DEBUG("Client buffer reallocation succeeded.");
-                client->refbuf->data = new_data;
-                client->refbuf->len = buf_len;
                 ret = util_http_build_header(client->refbuf->data, buf_len, 0,
                                              0, 200, NULL,
                                              "text/xml", "utf-8",
@@ -57,6 +57,11 @@
 #define CONFIG_DEFAULT_SHOUTCAST_MOUNT  "/stream"
 #define CONFIG_DEFAULT_SHOUTCAST_USER   "source"
 #define CONFIG_DEFAULT_FILESERVE        1
+#define CONFIG_DEFAULT_FILESERVE_THREADS 1
+#define CONFIG_DEFAULT_ACCEPTOR_THREADS 1
+#define CONFIG_DEFAULT_REQUEST_THREADS  2
+#define CONFIG_DEFAULT_RESERVED_CLIENTS 2
+#define CONFIG_DEFAULT_TLS_HANDSHAKE_THREADS 1
 #define CONFIG_DEFAULT_TOUCH_FREQ       5
 #define CONFIG_DEFAULT_HOSTNAME         "localhost"
 #define CONFIG_DEFAULT_PLAYLIST_LOG     NULL
@@ -793,6 +798,16 @@ static void _set_defaults(ice_config_t *configuration)
         ->source_limit = CONFIG_DEFAULT_SOURCE_LIMIT;
     configuration
         ->queue_size_limit = CONFIG_DEFAULT_QUEUE_SIZE_LIMIT;
+    configuration
+        ->fileserve_threads = CONFIG_DEFAULT_FILESERVE_THREADS;
+    configuration
+        ->acceptor_threads = CONFIG_DEFAULT_ACCEPTOR_THREADS;
+    configuration
+        ->request_threads = CONFIG_DEFAULT_REQUEST_THREADS;
+    configuration
+        ->reserved_clients = CONFIG_DEFAULT_RESERVED_CLIENTS;
+    configuration
+        ->tls_handshake_threads = CONFIG_DEFAULT_TLS_HANDSHAKE_THREADS;
     configuration
         ->client_timeout = CONFIG_DEFAULT_CLIENT_TIMEOUT;
     configuration
@@ -1117,6 +1132,28 @@ static void _parse_limits(xmlDocPtr     doc,
             __read_int(doc, node, &configuration->source_limit, "<sources> must not be empty.");
         } else if (xmlStrcmp(node->name, XMLSTR("queue-size")) == 0) {
             __read_unsigned_int(doc, node, &configuration->queue_size_limit, "<queue-size> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("fileserve-threads")) == 0) {
+            __read_unsigned_int(doc, node, &configuration->fileserve_threads, "<fileserve-threads> must not be empty.");
+            if (configuration->fileserve_threads == 0)
+                configuration->fileserve_threads = 1;
+            if (configuration->fileserve_threads > 64)
+                configuration->fileserve_threads = 64; /* deny super huge values */
+        } else if (xmlStrcmp(node->name, XMLSTR("acceptor-threads")) == 0) {
+            __read_unsigned_int(doc, node, &configuration->acceptor_threads, "<acceptor-threads> must not be empty.");
+            if (configuration->acceptor_threads == 0)
+                configuration->acceptor_threads = 1;
+            if (configuration->acceptor_threads > 64)
+                configuration->acceptor_threads = 64; /* deny super huge values */
+        } else if (xmlStrcmp(node->name, XMLSTR("request-threads")) == 0) {
+            __read_unsigned_int(doc, node, &configuration->request_threads, "<request-threads> must not be empty.");
+            if (configuration->request_threads > 64)
+                configuration->request_threads = 64; /* deny super huge values */
+        } else if (xmlStrcmp(node->name, XMLSTR("reserved-clients")) == 0) {
+            __read_unsigned_int(doc, node, &configuration->reserved_clients, "<reserved-clients> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("tls-handshake-threads")) == 0) {
+            __read_unsigned_int(doc, node, &configuration->tls_handshake_threads, "<tls-handshake-threads> must not be empty.");
+            if (configuration->tls_handshake_threads > 64)
+                configuration->tls_handshake_threads = 64; /* deny super huge values */
         } else if (xmlStrcmp(node->name, XMLSTR("threadpool")) == 0) {
             ICECAST_LOG_WARN("<threadpool> functionality was removed in Icecast"
 			     " version 2.3.0, please remove this from your config.");
@@ -1137,6 +1174,16 @@ static void _parse_limits(xmlDocPtr     doc,
             __read_unsigned_int(doc, node, &configuration->burst_size, "<burst-size> must not be empty.");
         }
     } while ((node = node->next));
+
+    /* listeners must be left some room, whichever order these came in */
+    if (configuration->reserved_clients &&
+            (int)configuration->reserved_clients >= configuration->client_limit) {
+        unsigned int reserved = configuration->client_limit > 1 ? configuration->client_limit - 1 : 0;
+
+        ICECAST_LOG_WARN("<reserved-clients> of %u leaves no room for listeners within <clients> of %d, using %u.",
+                configuration->reserved_clients, configuration->client_limit, reserved);
+        configuration->reserved_clients = reserved;
+    }
 }
 
 static void _parse_mount_oldstyle_authentication(mount_proxy    *mount,
@@ -1326,6 +1373,7 @@ static void _parse_mount(xmlDocPtr      doc,
     mount->max_listeners        = -1;
     mount->burst_size           = -1;
     mount->mp3_meta_interval    = -1;
+    mount->ogg_aggregate_size   = -1;
     mount->yp_public            = -1;
     mount->max_history          = -1;
     mount->next                 = NULL;
@@ -1395,6 +1443,10 @@ static void _parse_mount(xmlDocPtr      doc,
             __read_int(doc, node, &mount->mp3_meta_interval, "<mp3-metadata-interval> must not be empty.");
         } else if (xmlStrcmp(node->name, XMLSTR("icy-metadata-interval")) == 0) {
             __read_int(doc, node, &mount->mp3_meta_interval, "<icy-metadata-interval> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("ogg-aggregate-size")) == 0) {
+            __read_int(doc, node, &mount->ogg_aggregate_size, "<ogg-aggregate-size> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("ogg-aggregate-latency")) == 0) {
+            __read_unsigned_int(doc, node, &mount->ogg_aggregate_latency, "<ogg-aggregate-latency> must not be empty.");
         } else if (xmlStrcmp(node->name, XMLSTR("fallback-override")) == 0) {
             tmp = (char *)xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
             mount->fallback_override = util_str_to_bool(tmp);
@@ -1459,6 +1511,22 @@ static void _parse_mount(xmlDocPtr      doc,
             __read_unsigned_int(doc, node, &mount->source_timeout, "<source-timeout> must not be empty.");
         } else if (xmlStrcmp(node->name, XMLSTR("burst-size")) == 0) {
             __read_int(doc, node, &mount->burst_size, "<burst-size> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("burst-duration")) == 0) {
+            __read_unsigned_int(doc, node, &mount->burst_duration, "<burst-duration> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("listener-readiness")) == 0) {
+            tmp = (char *)xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
+            mount->listener_readiness = util_str_to_bool(tmp);
+            if(tmp)
+                xmlFree(tmp);
+        } else if (xmlStrcmp(node->name, XMLSTR("queue-ring")) == 0) {
+            tmp = (char *)xmlNodeListGetString(doc, node->xmlChildrenNode, 1);
+            mount->queue_ring = util_str_to_bool(tmp);
+            if(tmp)
+                xmlFree(tmp);
+        } else if (xmlStrcmp(node->name, XMLSTR("listener-threads")) == 0) {
+            __read_unsigned_int(doc, node, &mount->listener_threads, "<listener-threads> must not be empty.");
+            if (mount->listener_threads > 64)
+                mount->listener_threads = 64; /* deny super huge values */
         } else if (xmlStrcmp(node->name, XMLSTR("cluster-password")) == 0) {
             mount->cluster_password = (char *)xmlNodeListGetString(doc,
                 node->xmlChildrenNode, 1);
@@ -1759,6 +1827,10 @@ static void _parse_listen_socket(xmlDocPtr      doc,
                 node->xmlChildrenNode, 1);
         } else if (xmlStrcmp(node->name, XMLSTR("so-sndbuf")) == 0) {
             __read_int(doc, node, &listener->so_sndbuf, "<so-sndbuf> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("connection-rate")) == 0) {
+            __read_unsigned_int(doc, node, &listener->connection_rate, "<connection-rate> must not be empty.");
+        } else if (xmlStrcmp(node->name, XMLSTR("connection-burst")) == 0) {
+            __read_unsigned_int(doc, node, &listener->connection_burst, "<connection-burst> must not be empty.");
         }
     } while ((node = node->next));
 
@@ -1771,6 +1843,8 @@ static void _parse_listen_socket(xmlDocPtr      doc,
         listener_t *sc_port = calloc(1, sizeof(listener_t));
         sc_port->port = listener->port+1;
         sc_port->shoutcast_compat = 1;
+        sc_port->connection_rate = listener->connection_rate;
+        sc_port->connection_burst = listener->connection_burst;
         sc_port->shoutcast_mount = (char*)xmlStrdup(XMLSTR(listener->shoutcast_mount));
         if (listener->bind_address)
             sc_port->bind_address = (char*)xmlStrdup(XMLSTR(listener->bind_address));
@@ -2304,8 +2378,16 @@ static void merge_mounts(mount_proxy * dst, mount_proxy * src)
         dst->no_mount = src->no_mount;
     if (dst->burst_size == -1)
         dst->burst_size = src->burst_size;
+    if (!dst->burst_duration)
+        dst->burst_duration = src->burst_duration;
     if (!dst->queue_size_limit)
         dst->queue_size_limit = src->queue_size_limit;
+    if (!dst->listener_threads)
+        dst->listener_threads = src->listener_threads;
+    if (!dst->listener_readiness)
+        dst->listener_readiness = src->listener_readiness;
+    if (!dst->queue_ring)
+        dst->queue_ring = src->queue_ring;
     if (!dst->hidden)
         dst->hidden = src->hidden;
     if (!dst->source_timeout)
@@ -2314,6 +2396,10 @@ static void merge_mounts(mount_proxy * dst, mount_proxy * src)
         dst->charset = (char*)xmlStrdup((xmlChar*)src->charset);
     if (dst->mp3_meta_interval == -1)
         dst->mp3_meta_interval = src->mp3_meta_interval;
+    if (dst->ogg_aggregate_size == -1)
+        dst->ogg_aggregate_size = src->ogg_aggregate_size;
+    if (!dst->ogg_aggregate_latency)
+        dst->ogg_aggregate_latency = src->ogg_aggregate_latency;
     if (!dst->cluster_password)
         dst->cluster_password = (char*)xmlStrdup((xmlChar*)src->cluster_password);
     if (!dst->max_listener_duration)
@@ -2404,18 +2490,12 @@ mount_proxy *config_find_mount (ice_config_t        *config,
 listener_t *config_get_listen_sock(ice_config_t *config, connection_t *con)
 {
     listener_t *listener;
-    int i = 0;
+    int i;
 
+    if (con->listener < 0 || con->listener >= global.server_sockets)
+        return NULL;
     listener = config->listen_sock;
-    while (listener) {
-        if (i >= global.server_sockets) {
-            listener = NULL;
-        } else {
-            if (global.serversock[i] == con->serversock)
-                break;
-            listener = listener->next;
-            i++;
-        }
-    }
+    for (i = 0; listener && i < con->listener; i++)
+        listener = listener->next;
     return listener;
 }
@@ -122,7 +122,18 @@ typedef struct _mount_proxy {
      * from global setting
      */
     int burst_size;
+    /* burst as play time in ms for streams where it is known, 0 uses
+     * burst_size */
+    unsigned int burst_duration;
     unsigned int queue_size_limit;
+    /* number of threads writing to the listeners of this mount,
+     * 0 take the default (the source thread only)
+     */
+    unsigned int listener_threads;
+    /* only write to listeners whose socket has become writable */
+    int listener_readiness;
+    /* keep the queue data in one contiguous region */
+    int queue_ring;
     /* Do we list this on the xsl pages */
     int hidden;
     /* source timeout in seconds */
@@ -131,6 +142,11 @@ typedef struct _mount_proxy {
     char *charset;
     /* outgoing per-stream metadata interval */
     int mp3_meta_interval;
+    /* Ogg pages are queued together up to this many bytes, -1 for the
+     * default and 0 for a page at a time, and held no longer than the
+     * latency in ms, 0 for the default */
+    int ogg_aggregate_size;
+    unsigned int ogg_aggregate_latency;
     /* additional HTTP headers */
     ice_config_http_header_t *http_headers;
 
@@ -169,6 +185,8 @@ typedef struct _listener_t {
     struct _listener_t *next;
     int port;
     int so_sndbuf;
+    unsigned int connection_rate;
+    unsigned int connection_burst;
     char *bind_address;
     int shoutcast_compat;
     char *shoutcast_mount;
@@ -195,6 +213,11 @@ typedef struct ice_config_tag {
     int header_timeout;
     int source_timeout;
     int fileserve;
+    unsigned int fileserve_threads;
+    unsigned int acceptor_threads;
+    unsigned int request_threads;
+    unsigned int reserved_clients;
+    unsigned int tls_handshake_threads;
     int on_demand; /* global setting for all relays */
 
     char *shoutcast_mount;
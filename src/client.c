@@ -41,6 +41,7 @@
 #include "logging.h"
 
 #include "util.h"
+#include "global.h"
 
 /* for ADMIN_COMMAND_ERROR */
 #include "admin.h"
@@ -54,10 +55,30 @@
 
 static inline void client_send_500(client_t *client, const char *message);
 
+/* request details a listener still needs once streaming, for the access
+ * log, listener listings, events and releasing it from URL auth */
+static const char *client_compact_vars[] = {
+    HTTPP_VAR_PROTOCOL,
+    HTTPP_VAR_VERSION,
+    HTTPP_VAR_REQ_TYPE,
+    HTTPP_VAR_URI,
+    HTTPP_VAR_RAWURI,
+    "user-agent",
+    "referer",
+    NULL
+};
+
+/* compacted clients and their memory, protected by the global lock */
+static unsigned long client_compact_count;
+static size_t client_compact_bytes;
+static size_t client_compact_reported;
+
 /* create a client_t with the provided connection and parser details. Return
  * 0 on success, -1 if server limit has been reached.  In either case a
  * client_t is returned just in case a message needs to be returned. Should
- * be called with global lock held.
+ * be called with global lock held. Without a parser the request is still to
+ * be read, such clients may use the reserved slots on top of the limit
+ * until it is known what they are for.
  */
 int client_create(client_t **c_ptr, connection_t *con, http_parser_t *parser)
 {
@@ -71,7 +92,12 @@ int client_create(client_t **c_ptr, connection_t *con, http_parser_t *parser)
     config = config_get_config();
 
     global.clients++;
-    if (config->client_limit < global.clients) {
+    if (parser == NULL) {
+        client->unclassified = 1;
+        global.unclassified++;
+    }
+    if (config->client_limit < global.clients - global.unclassified ||
+            config->client_limit + (int)config->reserved_clients < global.clients) {
         ICECAST_LOG_WARN("server client limit reached (%d/%d)", config->client_limit, global.clients);
     } else {
         ret = 0;
@@ -101,7 +127,7 @@ static inline void client_reuseconnection(client_t *client) {
         return;
 
     con = client->con;
-    con = connection_create(con->sock, con->serversock, strdup(con->ip));
+    con = connection_create(con->sock, con->listener, strdup(con->ip));
     reuse = client->reuse;
     client->con->sock = -1; /* TODO: do not use magic */
 
@@ -162,7 +188,13 @@ void client_destroy(client_t *client)
 
     global_lock();
     global.clients--;
+    if (client->unclassified)
+        global.unclassified--;
     stats_event_args(NULL, "clients", "%d", global.clients);
+    if (client->compact_size) {
+        client_compact_count--;
+        client_compact_bytes -= client->compact_size;
+    }
     global_unlock();
 
     /* we need to free client specific format data (if any) */
@@ -177,6 +209,74 @@ void client_destroy(client_t *client)
     free(client);
 }
 
+static size_t client_string_size(const char *str)
+{
+    return str ? strlen(str) + 1 : 0;
+}
+
+/* Drop what a listener no longer needs once its response headers are
+ * out. A listener can stay for days, so the full request headers are
+ * replaced by the few details still looked at and the password is freed
+ * unless its authenticator wants it again on release.
+ */
+void client_compact(client_t *client)
+{
+    size_t size = sizeof(client_t) + sizeof(connection_t);
+    int i;
+
+    if (client->compact_size)
+        return;
+
+    if (client->parser) {
+        http_parser_t *parser = httpp_create_parser();
+
+        if (parser) {
+            httpp_initialize(parser, NULL);
+            parser->req_type = client->parser->req_type;
+            for (i = 0; client_compact_vars[i]; i++) {
+                const char *value = httpp_getvar(client->parser, client_compact_vars[i]);
+
+                if (value == NULL)
+                    continue;
+                httpp_setvar(parser, client_compact_vars[i], value);
+                size += sizeof(avl_node) + sizeof(http_var_t) +
+                    client_string_size(client_compact_vars[i]) + client_string_size(value);
+            }
+            httpp_destroy(client->parser);
+            client->parser = parser;
+            size += sizeof(http_parser_t);
+        }
+    }
+
+    if (client->password && (client->auth == NULL || client->auth->release_client == NULL)) {
+        free(client->password);
+        client->password = NULL;
+    }
+
+    size += client_string_size(client->con->ip) + client_string_size(client->username) +
+        client_string_size(client->password) + client_string_size(client->role);
+
+    global_lock();
+    client->compact_size = size;
+    client_compact_count++;
+    client_compact_bytes += size;
+    global_unlock();
+}
+
+/* report the average memory held by a compacted listener */
+void client_stats(void)
+{
+    size_t average;
+
+    global_lock();
+    average = client_compact_count ? client_compact_bytes / client_compact_count : 0;
+    global_unlock();
+
+    if (average != client_compact_reported)
+        stats_event_args(NULL, "listener_memory", "%lu", (unsigned long)average);
+    client_compact_reported = average;
+}
+
 /* helper function for reading data from a client */
 static ssize_t __client_read_bytes_real(client_t *client, void *buf, size_t len)
 {
@@ -376,6 +476,18 @@ int client_send_bytes(client_t *client, const void *buf, unsigned len)
     return ret;
 }
 
+/* helper function for sending a list of blocks to a client in one go,
+ * returns the number of bytes written like client_send_bytes */
+int client_send_iovec(client_t *client, const struct iovec *iov, int count)
+{
+    int ret = client->con->sendv(client->con, iov, count);
+
+    if (client->con->error)
+        ICECAST_LOG_DEBUG("Client connection died");
+
+    return ret;
+}
+
 void client_set_queue(client_t *client, refbuf_t *refbuf)
 {
     refbuf_t *to_release = client->refbuf;
@@ -23,6 +23,7 @@
 #include "refbuf.h"
 #include "acl.h"
 #include "cfgfile.h"
+#include "timerwheel.h"
 #include "common/httpp/httpp.h"
 #include "common/httpp/encoding.h"
 
@@ -66,6 +67,9 @@ typedef struct _client_tag
     /* admin command if any. ADMIN_COMMAND_ERROR if not an admin command. */
     int admin_command;
 
+    /* counted in global.unclassified until its request is known */
+    int unclassified;
+
     /* authentication instances we still need to go thru */
     struct auth_stack_tag *authstack;
 
@@ -105,6 +109,16 @@ typedef struct _client_tag
     /* function to check if refbuf needs updating */
     int (*check_buffer)(struct source_tag *source, struct _client_tag *client);
 
+    /* estimated memory held once compacted, 0 before */
+    size_t compact_size;
+
+    /* index in the listener table of the source serving it */
+    unsigned int listener_slot;
+    /* next on the pending list of a source */
+    struct _client_tag *pending_next;
+    /* ends the connection at its discon_time */
+    timerwheel_timer_t time_limit;
+
 } client_t;
 
 int client_create (client_t **c_ptr, connection_t *con, http_parser_t *parser);
@@ -113,7 +127,10 @@ void client_send_error_by_id(client_t *client, int id);
 void client_send_101(client_t *client, reuse_t reuse);
 void client_send_426(client_t *client, reuse_t reuse);
 int client_send_bytes (client_t *client, const void *buf, unsigned len);
+int client_send_iovec (client_t *client, const struct iovec *iov, int count);
 int client_read_bytes (client_t *client, void *buf, unsigned len);
 void client_set_queue (client_t *client, refbuf_t *refbuf);
+void client_compact (client_t *client);
+void client_stats (void);
 
 #endif  /* __CLIENT_H__ */
@@ -29,6 +29,7 @@
 #ifndef _WIN32
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netdb.h>
 #else
 #include <winsock2.h>
 #endif
@@ -39,6 +40,7 @@
 #include "common/avl/avl.h"
 #include "common/net/sock.h"
 #include "common/httpp/httpp.h"
+#include "common/timing/timing.h"
 
 #include "cfgfile.h"
 #include "global.h"
@@ -61,6 +63,10 @@
 #include "auth.h"
 #include "matchfile.h"
 #include "tls.h"
+#include "pollset.h"
+#include "workers.h"
+#include "ratelimit.h"
+#include "timerwheel.h"
 
 #define CATMODULE "connection"
 
@@ -85,6 +91,15 @@ typedef struct client_queue_tag {
     int stream_offset;
     int shoutcast;
     char *shoutcast_mount;
+    int scan_offset;        /* where the scan for the end of headers resumes */
+    int scan_line;          /* start of the line being scanned */
+    int scan_eol_cr;        /* \r before the last \n seen, -1 before the first */
+    int polled;             /* socket is in the pollset of the acceptor */
+    int ready;              /* reported readable since the last read */
+    unsigned int handshake_events; /* what the handshake thread polls for */
+    struct timeval handshake_start;
+    timerwheel_timer_t header_timer; /* on the wheel of the thread holding it */
+    int timed_out;          /* header timeout reached */
     struct client_queue_tag *next;
 } client_queue_t;
 
@@ -93,21 +108,138 @@ typedef struct _thread_queue_tag {
     struct _thread_queue_tag *next;
 } thread_queue_t;
 
-static spin_t _connection_lock; // protects _current_id, _con_queue, _con_queue_tail
+/* Each acceptor polls its own set of listening sockets and keeps its own
+ * queues of clients sending request headers. With more than one acceptor
+ * every listener gets one socket per acceptor bound with SO_REUSEPORT, so
+ * the kernel spreads new connections across them.
+ */
+typedef struct acceptor_tag {
+    unsigned int id;
+    thread_type *thread;
+    sock_t *socks;          /* sockets polled, SOCK_ERROR once closed */
+    int count;
+    pollset_t *pollset;     /* listening sockets and requests, NULL if unavailable */
+
+    /* only used by the acceptor thread itself */
+    timerwheel_t *timers;   /* header timeouts of the request queue */
+    int header_timeout;
+    client_queue_t *req_queue, **req_queue_tail;
+    client_queue_t *con_queue, **con_queue_tail;
+
+    /* clients handed over by other threads, protected by _connection_lock */
+    client_queue_t *incoming;
+} acceptor_t;
+
+/* number of connections accepted from one socket before looking at the others */
+#define ACCEPT_BATCH    64
+/* most events taken from the pollset in one go */
+#define ACCEPTOR_EVENTS 64
+
+static spin_t _connection_lock; // protects _current_id, _acceptors and the incoming queues
 static volatile unsigned long _current_id = 0;
 static int _initialized = 0;
 
-static volatile client_queue_t *_req_queue = NULL, **_req_queue_tail = &_req_queue;
-static volatile client_queue_t *_con_queue = NULL, **_con_queue_tail = &_con_queue;
+static acceptor_t *_acceptors;
+static unsigned int _acceptor_count;
+static unsigned int _next_acceptor;
 static int tls_ok;
 static tls_ctx_t *tls_ctx;
 
+/* TLS handshakes run on threads of their own so that the key exchange of a
+ * flood of HTTPS connections does not hold up the acceptors. Each thread
+ * drives many non-blocking handshakes from its pollset and hands finished
+ * ones back to the acceptors for reading the request.
+ */
+typedef struct handshaker_tag {
+    thread_type *thread;
+    pollset_t *pollset;
+
+    /* only used by the handshake thread itself */
+    timerwheel_t *timers;   /* header timeouts of the pending handshakes */
+    client_queue_t *pending;
+
+    /* clients handed over by the acceptors, protected by _handshake_lock */
+    client_queue_t *incoming;
+} handshaker_t;
+
+static spin_t _handshake_lock; // protects the incoming queues and handshake stats
+static handshaker_t *_handshakers;
+static unsigned int _handshaker_count; // only changes while no acceptor runs
+static unsigned int _next_handshaker;
+static volatile int _handshakers_running;
+
+static unsigned long _tls_handshakes, _tls_resumed, _tls_failed;
+static unsigned long _tls_time_total, _tls_time_max, _tls_time_count;
+static unsigned long _tls_reported[3], _tls_time_reported[2];
+
+/* Requests which may take a while, like admin pages, XSLT transforms of
+ * the stats and opening files, are handed to a pool of threads so they do
+ * not hold up the acceptors.
+ */
+typedef enum {
+    REQUEST_ADMIN,
+    REQUEST_XSLT,
+    REQUEST_FILE
+} request_type_t;
+
+typedef struct request_job_tag {
+    request_type_t type;
+    client_t *client;
+    char *uri;
+} request_job_t;
+
+/* most requests waiting for the pool before more are turned away */
+#define REQUEST_QUEUE_LIMIT 256
+
+static rwlock_t _request_lock; // protects _request_queue
+static workqueue_t *_request_queue;
+static unsigned long _request_rejected, _request_rejected_reported;
+static unsigned int _request_depth_reported;
+static unsigned long _request_wait_reported[2];
+
+/* Admission control. Once it is known what a request is for, listeners
+ * are turned away when fewer than <reserved-clients> slots are left, so
+ * sources and admin requests can still get in, and those at the client
+ * limit. Connections whose request is still to come are not counted in
+ * that but may only use the reserved slots on top of the limit, beyond
+ * which they are turned away straight after accept(). All get the same
+ * reply which is built once.
+ */
+typedef enum {
+    ADMISSION_LISTENER,
+    ADMISSION_SOURCE,
+    ADMISSION_ADMIN,
+    ADMISSION_CLASSES
+} admission_class_t;
+
+#define ADMISSION_RETRY_AFTER "10"
+
+static const char _busy_response[] =
+    "HTTP/1.0 503 Service Unavailable\r\n"
+    "Retry-After: " ADMISSION_RETRY_AFTER "\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 17\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Server is busy.\r\n";
+
+static const char *_admission_names[ADMISSION_CLASSES] = {"listener", "source", "admin"};
+
+// protected by _connection_lock
+static unsigned long _admission_admitted[ADMISSION_CLASSES], _admission_rejected[ADMISSION_CLASSES];
+static unsigned long _admission_early;
+static unsigned long _admission_reported[ADMISSION_CLASSES * 2 + 1];
+
 /* filtering client connection based on IP */
 static matchfile_t *banned_ip, *allowed_ip;
 
+/* per address connection rate limits, one for each of global.serversock */
+static ratelimit_t **_ratelimits;
+static uint64_t _ratelimit_reported;
+
 rwlock_t _source_shutdown_rwlock;
 
-static void _handle_connection(void);
+static void _handle_connection(acceptor_t *acceptor);
 static void get_tls_certificate(ice_config_t *config);
 
 void connection_initialize(void)
@@ -116,13 +248,13 @@ void connection_initialize(void)
         return;
 
     thread_spin_create (&_connection_lock);
+    thread_spin_create (&_handshake_lock);
     thread_mutex_create(&move_clients_mutex);
     thread_rwlock_create(&_source_shutdown_rwlock);
+    thread_rwlock_create(&_request_lock);
     thread_cond_create(&global.shutdown_cond);
-    _req_queue = NULL;
-    _req_queue_tail = &_req_queue;
-    _con_queue = NULL;
-    _con_queue_tail = &_con_queue;
+    _acceptors = NULL;
+    _acceptor_count = 0;
 
     _initialized = 1;
 }
@@ -138,7 +270,9 @@ void connection_shutdown(void)
  
     thread_cond_destroy(&global.shutdown_cond);
     thread_rwlock_destroy(&_source_shutdown_rwlock);
+    thread_rwlock_destroy(&_request_lock);
     thread_spin_destroy (&_connection_lock);
+    thread_spin_destroy (&_handshake_lock);
     thread_mutex_destroy(&move_clients_mutex);
 
     _initialized = 0;
@@ -165,6 +299,7 @@ static unsigned long _next_connection_id(void)
 static void get_tls_certificate(ice_config_t *config)
 {
     const char *keyfile;
+    tls_ctx_t *old = tls_ctx;
 
     config->tls_ok = tls_ok = 0;
 
@@ -172,8 +307,9 @@ static void get_tls_certificate(ice_config_t *config)
     if (!keyfile)
         keyfile = config->tls_context.cert_file;
 
-    tls_ctx_unref(tls_ctx);
     tls_ctx = tls_ctx_new(config->tls_context.cert_file, keyfile, config->tls_context.cipher_list);
+    tls_ctx_keep_sessions(tls_ctx, old);
+    tls_ctx_unref(old);
     if (!tls_ctx) {
         ICECAST_LOG_INFO("No TLS capability on any configured ports");
         return;
@@ -211,6 +347,26 @@ static int connection_send_tls(connection_t *con, const void *buf, size_t len)
     }
     return bytes;
 }
+
+/* TLS records are built per write, so just go through the blocks until
+ * one can not be written completely */
+static int connection_sendv_tls(connection_t *con, const struct iovec *iov, size_t count)
+{
+    int written = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        int bytes = connection_send_tls(con, iov[i].iov_base, iov[i].iov_len);
+
+        if (bytes < 0)
+            return written ? written : bytes;
+        written += bytes;
+        if ((size_t)bytes < iov[i].iov_len)
+            break;
+    }
+    return written;
+}
 #else
 
 /* TLS not compiled in, so at least log it */
@@ -242,25 +398,50 @@ static int connection_send(connection_t *con, const void *buf, size_t len)
     if (bytes < 0) {
         if (!sock_recoverable(sock_error()))
             con->error = 1;
+        else
+            con->write_blocked = 1;
     } else {
+        if ((size_t)bytes < len)
+            con->write_blocked = 1;
         con->sent_bytes += bytes;
     }
     return bytes;
 }
 
-connection_t *connection_create (sock_t sock, sock_t serversock, char *ip)
+static int connection_sendv(connection_t *con, const struct iovec *iov, size_t count)
+{
+    size_t len = 0, i;
+    int bytes = sock_writev(con->sock, iov, count);
+
+    if (bytes < 0) {
+        if (!sock_recoverable(sock_error()))
+            con->error = 1;
+        else
+            con->write_blocked = 1;
+        return bytes;
+    }
+    for (i = 0; i < count; i++)
+        len += iov[i].iov_len;
+    if ((size_t)bytes < len)
+        con->write_blocked = 1;
+    con->sent_bytes += bytes;
+    return bytes;
+}
+
+connection_t *connection_create (sock_t sock, int listener, char *ip)
 {
     connection_t *con;
     con = (connection_t *)calloc(1, sizeof(connection_t));
     if (con) {
         con->sock       = sock;
-        con->serversock = serversock;
+        con->listener   = listener;
         con->con_time   = time(NULL);
         con->id         = _next_connection_id();
         con->ip         = ip;
         con->tlsmode    = ICECAST_TLSMODE_AUTO;
         con->read       = connection_read;
         con->send       = connection_send;
+        con->sendv      = connection_sendv;
     }
 
     return con;
@@ -277,6 +458,7 @@ void connection_uses_tls(connection_t *con)
     con->tlsmode = ICECAST_TLSMODE_RFC2818;
     con->read = connection_read_tls;
     con->send = connection_send_tls;
+    con->sendv = connection_sendv_tls;
     con->tls = tls_new(tls_ctx);
     tls_set_incoming(con->tls);
     tls_set_socket(con->tls, con->sock);
@@ -288,59 +470,77 @@ ssize_t connection_read_bytes(connection_t *con, void *buf, size_t len)
     return con->read(con, buf, len);
 }
 
-static sock_t wait_for_serversock(int timeout)
+/* close a listening socket which reported an error. The slot is kept so
+ * that sockets still line up with the listeners they belong to
+ */
+static void acceptor_close_socket(acceptor_t *acceptor, int i, int close_it)
+{
+    if (acceptor->pollset)
+        pollset_remove(acceptor->pollset, acceptor->socks[i]);
+    if (close_it) {
+        sock_close (acceptor->socks[i]);
+        ICECAST_LOG_WARN("Had to close a listening socket");
+    }
+    if (acceptor->id == 0)
+        global.serversock[i] = SOCK_ERROR;
+    acceptor->socks[i] = SOCK_ERROR;
+}
+
+/* wait for any of the sockets of the acceptor to become readable, the
+ * indexes of those are stored in ready. Returns the number of them.
+ */
+static int wait_for_serversock(acceptor_t *acceptor, int timeout, int *ready)
 {
 #ifdef HAVE_POLL
-    struct pollfd ufds [global.server_sockets];
-    int i, ret;
+    struct pollfd ufds [acceptor->count];
+    int idx [acceptor->count];
+    int i, ret, count = 0, found = 0;
 
-    for(i=0; i < global.server_sockets; i++) {
-        ufds[i].fd = global.serversock[i];
-        ufds[i].events = POLLIN;
-        ufds[i].revents = 0;
+    for(i=0; i < acceptor->count; i++) {
+        if (acceptor->socks[i] == SOCK_ERROR)
+            continue;
+        ufds[count].fd = acceptor->socks[i];
+        ufds[count].events = POLLIN;
+        ufds[count].revents = 0;
+        idx[count++] = i;
     }
 
-    ret = poll(ufds, global.server_sockets, timeout);
-    if(ret < 0) {
-        return SOCK_ERROR;
-    } else if(ret == 0) {
-        return SOCK_ERROR;
-    } else {
-        int dst;
-        for(i=0; i < global.server_sockets; i++) {
-            if(ufds[i].revents & POLLIN)
-                return ufds[i].fd;
-            if(ufds[i].revents & (POLLHUP|POLLERR|POLLNVAL)) {
-                if (ufds[i].revents & (POLLHUP|POLLERR)) {
-                    sock_close (global.serversock[i]);
-                    ICECAST_LOG_WARN("Had to close a listening socket");
-                }
-                global.serversock[i] = SOCK_ERROR;
-            }
-        }
-        /* remove any closed sockets */
-        for(i=0, dst=0; i < global.server_sockets; i++) {
-            if (global.serversock[i] == SOCK_ERROR)
-            continue;
-            if (i!=dst)
-            global.serversock[dst] = global.serversock[i];
-            dst++;
+    if (count == 0) {
+        thread_sleep (timeout * 1000);
+        return 0;
+    }
+
+    ret = poll(ufds, count, timeout);
+    if(ret <= 0)
+        return 0;
+
+    for(i=0; i < count; i++) {
+        if(ufds[i].revents & POLLIN) {
+            ready[found++] = idx[i];
+        } else if(ufds[i].revents & (POLLHUP|POLLERR|POLLNVAL)) {
+            acceptor_close_socket (acceptor, idx[i], ufds[i].revents & (POLLHUP|POLLERR));
         }
-        global.server_sockets = dst;
-        return SOCK_ERROR;
     }
+    return found;
 #else
     fd_set rfds;
     struct timeval tv, *p=NULL;
-    int i, ret;
+    int i, ret, found = 0;
     sock_t max = SOCK_ERROR;
 
     FD_ZERO(&rfds);
 
-    for(i=0; i < global.server_sockets; i++) {
-        FD_SET(global.serversock[i], &rfds);
-        if (max == SOCK_ERROR || global.serversock[i] > max)
-            max = global.serversock[i];
+    for(i=0; i < acceptor->count; i++) {
+        if (acceptor->socks[i] == SOCK_ERROR)
+            continue;
+        FD_SET(acceptor->socks[i], &rfds);
+        if (max == SOCK_ERROR || acceptor->socks[i] > max)
+            max = acceptor->socks[i];
+    }
+
+    if (max == SOCK_ERROR) {
+        thread_sleep (timeout * 1000);
+        return 0;
     }
 
     if(timeout >= 0) {
@@ -350,101 +550,277 @@ static sock_t wait_for_serversock(int timeout)
     }
 
     ret = select(max+1, &rfds, NULL, NULL, p);
-    if(ret < 0) {
-        return SOCK_ERROR;
-    } else if(ret == 0) {
-        return SOCK_ERROR;
-    } else {
-        for(i=0; i < global.server_sockets; i++) {
-            if(FD_ISSET(global.serversock[i], &rfds))
-                return global.serversock[i];
-        }
-        return SOCK_ERROR; /* Should be impossible, stop compiler warnings */
+    if(ret <= 0)
+        return 0;
+
+    for(i=0; i < acceptor->count; i++) {
+        if(acceptor->socks[i] != SOCK_ERROR && FD_ISSET(acceptor->socks[i], &rfds))
+            ready[found++] = i;
     }
+    return found;
 #endif
 }
 
-static connection_t *_accept_connection(int duration)
+static void _acceptor_queue(acceptor_t *acceptor, connection_t *con);
+
+/* with the client limit reached, reply to a freshly accepted connection
+ * and close it. Returns 1 if that happened.
+ */
+static int _admission_full(int listener_index, sock_t sock)
 {
-    sock_t sock, serversock;
-    char *ip;
+    ice_config_t *config;
+    listener_t *listener;
+    connection_t con;
+    int clients, full, tls = 0;
 
-    serversock = wait_for_serversock (duration);
-    if (serversock == SOCK_ERROR)
-        return NULL;
+    global_lock();
+    clients = global.clients;
+    global_unlock();
 
-    /* malloc enough room for a full IP address (including ipv6) */
-    ip = (char *)malloc(MAX_ADDR_LEN);
-
-    sock = sock_accept(serversock, ip, MAX_ADDR_LEN);
-    if (sock != SOCK_ERROR) {
-        connection_t *con = NULL;
-        /* Make any IPv4 mapped IPv6 address look like a normal IPv4 address */
-        if (strncmp(ip, "::ffff:", 7) == 0)
-            memmove(ip, ip+7, strlen (ip+7)+1);
-
-        if (matchfile_match_allow_deny(allowed_ip, banned_ip, ip))
-            con = connection_create (sock, serversock, ip);
-        if (con)
-            return con;
-        sock_close(sock);
-    } else {
-        if (!sock_recoverable(sock_error())) {
-            ICECAST_LOG_WARN("accept() failed with error %d: %s", sock_error(), strerror(sock_error()));
-            thread_sleep(500000);
+    config = config_get_config();
+    full = clients >= config->client_limit + (int)config->reserved_clients;
+    if (full) {
+        memset(&con, 0, sizeof(con));
+        con.listener = listener_index;
+        listener = config_get_listen_sock(config, &con);
+        /* no plain text on connections which start with TLS */
+        if (listener && listener->tls == ICECAST_TLSMODE_RFC2818)
+            tls = 1;
+    }
+    config_release_config();
+
+    if (!full)
+        return 0;
+    if (!tls) {
+        sock_set_blocking(sock, 0);
+        sock_write_bytes(sock, _busy_response, sizeof(_busy_response) - 1);
+    }
+    sock_close(sock);
+
+    thread_spin_lock(&_connection_lock);
+    _admission_early++;
+    thread_spin_unlock(&_connection_lock);
+    return 1;
+}
+
+/* decide on a request once it is known what it is for. Listeners are
+ * refused when only the reserved slots are left, the others at the client
+ * limit. Returns 0 if admitted.
+ */
+static int _admission_check(client_t *client, const char *uri)
+{
+    admission_class_t class = ADMISSION_LISTENER;
+    ice_config_t *config;
+    int clients, refuse;
+
+    if (client->parser->req_type == httpp_req_source || client->parser->req_type == httpp_req_put) {
+        class = ADMISSION_SOURCE;
+    } else if (client->parser->req_type == httpp_req_stats || client->admin_command != ADMIN_COMMAND_ERROR ||
+            strcmp(uri, "/admin.cgi") == 0 || strncmp(uri, "/admin/", 7) == 0) {
+        class = ADMISSION_ADMIN;
+    }
+
+    global_lock();
+    if (client->unclassified) {
+        client->unclassified = 0;
+        global.unclassified--;
+    }
+    clients = global.clients - global.unclassified;
+    global_unlock();
+
+    config = config_get_config();
+    if (class == ADMISSION_LISTENER)
+        refuse = clients > config->client_limit - (int)config->reserved_clients;
+    else
+        refuse = clients > config->client_limit;
+    config_release_config();
+
+    thread_spin_lock(&_connection_lock);
+    if (refuse)
+        _admission_rejected[class]++;
+    else
+        _admission_admitted[class]++;
+    thread_spin_unlock(&_connection_lock);
+
+    if (refuse) {
+        client_send_bytes(client, _busy_response, sizeof(_busy_response) - 1);
+        client_destroy(client);
+        return -1;
+    }
+    return 0;
+}
+
+/* accept connections on a readable listening socket until there are none
+ * left waiting, returns the number accepted
+ */
+static int _accept_connections(acceptor_t *acceptor, int i)
+{
+    int accepted = 0;
+
+    while (accepted < ACCEPT_BATCH) {
+        sock_t sock;
+        char *ip;
+
+        /* malloc enough room for a full IP address (including ipv6) */
+        ip = (char *)malloc(MAX_ADDR_LEN);
+
+        sock = sock_accept(acceptor->socks[i], ip, MAX_ADDR_LEN);
+        if (sock != SOCK_ERROR) {
+            connection_t *con = NULL;
+            /* Make any IPv4 mapped IPv6 address look like a normal IPv4 address */
+            if (strncmp(ip, "::ffff:", 7) == 0)
+                memmove(ip, ip+7, strlen (ip+7)+1);
+
+            accepted++;
+            if (_ratelimits && !ratelimit_allow(_ratelimits[i], ip, timing_get_time())) {
+                /* don't spend anything on clients reconnecting too often */
+                sock_close(sock);
+                free(ip);
+                continue;
+            }
+            /* banned addresses are dropped without a word, even when full */
+            if (!matchfile_match_allow_deny(allowed_ip, banned_ip, ip)) {
+                sock_close(sock);
+                free(ip);
+                continue;
+            }
+            if (_admission_full(i, sock)) {
+                free(ip);
+                continue;
+            }
+            /* every acceptor has the sockets in the order of the listeners */
+            con = connection_create (sock, i, ip);
+            if (con) {
+                _acceptor_queue(acceptor, con);
+                continue;
+            }
+            sock_close(sock);
+        } else {
+            if (!sock_recoverable(sock_error())) {
+                ICECAST_LOG_WARN("accept() failed with error %d: %s", sock_error(), strerror(sock_error()));
+                thread_sleep(500000);
+            }
         }
+        free(ip);
+        if (sock == SOCK_ERROR)
+            break;
     }
-    free(ip);
-    return NULL;
+    return accepted;
 }
 
 
 /* add client to connection queue. At this point some header information
- * has been collected, so we now pass it onto the connection thread for
- * further processing
+ * has been collected, so we now pass it onto the connection handling
+ * for further processing
  */
-static void _add_connection(client_queue_t *node)
+static void _add_connection(acceptor_t *acceptor, client_queue_t *node)
 {
-    thread_spin_lock(&_connection_lock);
-    *_con_queue_tail = node;
-    _con_queue_tail = (volatile client_queue_t **) &node->next;
-    thread_spin_unlock(&_connection_lock);
+    *acceptor->con_queue_tail = node;
+    acceptor->con_queue_tail = &node->next;
 }
 
 
-/* this returns queued clients for the connection thread. headers are
+/* this returns queued clients for the connection handling. headers are
  * already provided, but need to be parsed.
  */
-static client_queue_t *_get_connection(void)
+static client_queue_t *_get_connection(acceptor_t *acceptor)
 {
-    client_queue_t *node = NULL;
-
-    thread_spin_lock(&_connection_lock);
+    client_queue_t *node = acceptor->con_queue;
 
-    if (_con_queue){
-        node = (client_queue_t *)_con_queue;
-        _con_queue = node->next;
-        if (_con_queue == NULL)
-            _con_queue_tail = &_con_queue;
+    if (node) {
+        acceptor->con_queue = node->next;
+        if (acceptor->con_queue == NULL)
+            acceptor->con_queue_tail = &acceptor->con_queue;
         node->next = NULL;
     }
-
-    thread_spin_unlock(&_connection_lock);
     return node;
 }
 
 
-/* run along queue checking for any data that has come in or a timeout */
-static void process_request_queue (void)
+/* Look for the end of the request headers in the data read so far,
+ * continuing where the last call stopped. Headers end with an empty line
+ * using the same line ending as the one before it, which covers \n, \r\n
+ * and the \r\r\n of nsvcap. For the shoutcast password a single line is
+ * enough. Returns 1 once found, stream_offset is then the start of any
+ * data after the headers.
+ */
+static int header_scan(client_queue_t *node)
 {
-    client_queue_t **node_ref = (client_queue_t **)&_req_queue;
-    ice_config_t *config;
-    int timeout;
+    const char *buf = node->client->refbuf->data;
+
+    while (node->scan_offset < node->offset) {
+        const char *eol = memchr(buf + node->scan_offset, '\n', node->offset - node->scan_offset);
+        int pos, cr = 0;
+
+        if (eol == NULL) {
+            node->scan_offset = node->offset;
+            break;
+        }
+        pos = eol - buf;
+        node->scan_offset = pos + 1;
+        while (cr < 3 && pos - cr > node->scan_line && buf[pos-cr-1] == '\r')
+            cr++;
+
+        if (node->shoutcast == 1)
+            return 1;
+        if (pos - node->scan_line == cr && cr <= 2 && node->scan_eol_cr >= cr) {
+            node->stream_offset = pos + 1;
+            return 1;
+        }
+        node->scan_eol_cr = cr;
+        node->scan_line = pos + 1;
+    }
+    return 0;
+}
+
+/* start the header scan over, for when the data has been moved */
+static void header_scan_reset(client_queue_t *node)
+{
+    node->scan_offset = 0;
+    node->scan_line = 0;
+    node->scan_eol_cr = -1;
+}
+
+static int _handshake_queue(client_queue_t *node);
+
+static void _header_timer_expired(timerwheel_timer_t *timer, void *arg)
+{
+    ((client_queue_t *)arg)->timed_out = 1;
+}
+
+/* set the client to be dropped once the header timeout since it connected
+ * is reached */
+static void _header_timer_arm(timerwheel_t *timers, client_queue_t *node, int timeout)
+{
+    node->timed_out = 0;
+    timerwheel_timer_init(&node->header_timer, _header_timer_expired, node);
+    timerwheel_add(timers, &node->header_timer, node->client->con->con_time + timeout);
+}
+
+/* take a node off the request queue, node_ref is the link pointing at it */
+static void _remove_request_queue(acceptor_t *acceptor, client_queue_t **node_ref)
+{
+    client_queue_t *node = *node_ref;
+
+    if (acceptor->req_queue_tail == &node->next)
+        acceptor->req_queue_tail = node_ref;
+    *node_ref = node->next;
+    node->next = NULL;
+    timerwheel_remove(&node->header_timer);
+    if (node->polled) {
+        pollset_remove(acceptor->pollset, node->client->con->sock);
+        node->polled = 0;
+    }
+}
+
+/* run along queue reading from any that reported data and dropping those
+ * which reached the header timeout */
+static void process_request_queue (acceptor_t *acceptor)
+{
+    client_queue_t **node_ref = &acceptor->req_queue;
     char peak;
 
-    config = config_get_config();
-    timeout = config->header_timeout;
-    config_release_config();
+    timerwheel_advance(acceptor->timers, time(NULL));
 
     while (*node_ref) {
         client_queue_t *node = *node_ref;
@@ -452,91 +828,88 @@ static void process_request_queue (void)
         int len = PER_CLIENT_REFBUF_SIZE - 1 - node->offset;
         char *buf = client->refbuf->data + node->offset;
 
-        if (client->con->tlsmode == ICECAST_TLSMODE_AUTO || client->con->tlsmode == ICECAST_TLSMODE_AUTO_NO_PLAIN) {
-            if (recv(client->con->sock, &peak, 1, MSG_PEEK) == 1) {
-                if (peak == 0x16) { /* TLS Record Protocol Content type 0x16 == Handshake */
-                    connection_uses_tls(client->con);
+        if (node->timed_out) {
+            len = 0;
+        } else if (node->scan_offset < node->offset) {
+            /* data left over from before, eg after the shoutcast password */
+            len = -1;
+        } else if (node->ready || node->polled == 0 || client->con->tls) {
+            /* TLS may hold data already taken from the socket */
+            node->ready = 0;
+            if (client->con->tlsmode == ICECAST_TLSMODE_AUTO || client->con->tlsmode == ICECAST_TLSMODE_AUTO_NO_PLAIN) {
+                if (recv(client->con->sock, &peak, 1, MSG_PEEK) == 1) {
+                    if (peak == 0x16) { /* TLS Record Protocol Content type 0x16 == Handshake */
+                        connection_uses_tls(client->con);
+                        if (_handshaker_count) {
+                            _remove_request_queue(acceptor, node_ref);
+                            _handshake_queue(node);
+                            continue;
+                        }
+                    }
                 }
             }
-        }
-
-        if (len > 0) {
-            if (client->con->con_time + timeout <= time(NULL)) {
-                len = 0;
-            } else {
+            if (len > 0) {
                 len = client_read_bytes(client, buf, len);
-            }
-        }
-
-        if (len > 0) {
-            int pass_it = 1;
-            char *ptr;
-
-            /* handle \n, \r\n and nsvcap which for some strange reason has
-             * EOL as \r\r\n */
-            node->offset += len;
-            client->refbuf->data[node->offset] = '\000';
-            do {
-                if (node->shoutcast == 1) {
-                    /* password line */
-                    if (strstr (client->refbuf->data, "\r\r\n") != NULL)
-                        break;
-                    if (strstr (client->refbuf->data, "\r\n") != NULL)
-                        break;
-                    if (strstr (client->refbuf->data, "\n") != NULL)
-                        break;
-                }
-                /* stream_offset refers to the start of any data sent after the
-                 * http style headers, we don't want to lose those */
-                ptr = strstr(client->refbuf->data, "\r\r\n\r\r\n");
-                if (ptr) {
-                    node->stream_offset = (ptr+6) - client->refbuf->data;
-                    break;
-                }
-                ptr = strstr(client->refbuf->data, "\r\n\r\n");
-                if (ptr) {
-                    node->stream_offset = (ptr+4) - client->refbuf->data;
-                    break;
+                if (len > 0) {
+                    node->offset += len;
+                    client->refbuf->data[node->offset] = '\000';
                 }
-                ptr = strstr(client->refbuf->data, "\n\n");
-                if (ptr) {
-                    node->stream_offset = (ptr+2) - client->refbuf->data;
-                    break;
-                }
-                pass_it = 0;
-            } while (0);
-
-            if (pass_it) {
-                if ((client_queue_t **)_req_queue_tail == &(node->next))
-                    _req_queue_tail = (volatile client_queue_t **)node_ref;
-                *node_ref = node->next;
-                node->next = NULL;
-                _add_connection(node);
-                continue;
             }
         } else {
-            if (len == 0 || client->con->error) {
-                if ((client_queue_t **)_req_queue_tail == &node->next)
-                    _req_queue_tail = (volatile client_queue_t **)node_ref;
-                *node_ref = node->next;
-                client_destroy(client);
-                free(node);
-                continue;
-            }
+            node_ref = &node->next;
+            continue;
+        }
+
+        if (len != 0 && header_scan(node)) {
+            _remove_request_queue(acceptor, node_ref);
+            _add_connection(acceptor, node);
+            continue;
+        }
+        if (len == 0 || client->con->error) {
+            _remove_request_queue(acceptor, node_ref);
+            client_destroy(client);
+            free(node);
+            continue;
         }
         node_ref = &node->next;
     }
-    _handle_connection();
+    _handle_connection(acceptor);
 }
 
 
 /* add node to the queue of requests. This is where the clients are when
  * initial http details are read.
  */
-static void _add_request_queue(client_queue_t *node)
+static void _add_request_queue(acceptor_t *acceptor, client_queue_t *node)
+{
+    if (node->client->con->tls && tls_handshake_done(node->client->con->tls) == 0 && _handshake_queue(node) == 0)
+        return;
+    *acceptor->req_queue_tail = node;
+    acceptor->req_queue_tail = &node->next;
+    _header_timer_arm(acceptor->timers, node, acceptor->header_timeout);
+    if (acceptor->pollset && pollset_add(acceptor->pollset, node->client->con->sock, POLLSET_READ, node) == 0)
+        node->polled = 1;
+}
+
+/* move clients handed over by other threads onto the request queue */
+static void _take_incoming(acceptor_t *acceptor)
 {
-    *_req_queue_tail = node;
-    _req_queue_tail = (volatile client_queue_t **)&node->next;
+    client_queue_t *node;
+
+    if (acceptor->incoming == NULL)
+        return;
+    thread_spin_lock(&_connection_lock);
+    node = acceptor->incoming;
+    acceptor->incoming = NULL;
+    thread_spin_unlock(&_connection_lock);
+
+    while (node) {
+        client_queue_t *next = node->next;
+
+        node->next = NULL;
+        _add_request_queue(acceptor, node);
+        node = next;
+    }
 }
 
 static client_queue_t *create_client_node(client_t *client)
@@ -549,6 +922,7 @@ static client_queue_t *create_client_node(client_t *client)
         return NULL;
 
     node->client = client;
+    header_scan_reset(node);
 
     config = config_get_config();
     listener = config_get_listen_sock(config, client->con);
@@ -568,7 +942,10 @@ static client_queue_t *create_client_node(client_t *client)
     return node;
 }
 
-void connection_queue(connection_t *con)
+static void _acceptor_hand_over(client_queue_t *node);
+
+/* create a client for a connection ready to read its request */
+static client_queue_t *connection_client_node(connection_t *con)
 {
     client_queue_t *node;
     client_t *client = NULL;
@@ -576,10 +953,13 @@ void connection_queue(connection_t *con)
     global_lock();
     if (client_create(&client, con, NULL) < 0) {
         global_unlock();
-        client_send_error_by_id(client, ICECAST_ERROR_GEN_CLIENT_LIMIT);
-        /* don't be too eager as this is an imposed hard limit */
-        thread_sleep(400000);
-        return;
+        /* raced with another acceptor past the check after accept() */
+        client_send_bytes(client, _busy_response, sizeof(_busy_response) - 1);
+        client_destroy(client);
+        thread_spin_lock(&_connection_lock);
+        _admission_early++;
+        thread_spin_unlock(&_connection_lock);
+        return NULL;
     }
 
     /* setup client for reading incoming http */
@@ -589,42 +969,439 @@ void connection_queue(connection_t *con)
         global_unlock();
         ICECAST_LOG_WARN("Failed to set tcp options on client connection, dropping");
         client_destroy(client);
-        return;
+        return NULL;
     }
     node = create_client_node(client);
     global_unlock();
 
     if (node == NULL) {
         client_destroy(client);
-        return;
+        return NULL;
     }
 
-    _add_request_queue(node);
     stats_event_inc(NULL, "connections");
+    return node;
+}
+
+static void _acceptor_queue(acceptor_t *acceptor, connection_t *con)
+{
+    client_queue_t *node = connection_client_node(con);
+
+    if (node)
+        _add_request_queue(acceptor, node);
+}
+
+/* queue a connection from another thread, eg one kept alive after a
+ * request. The acceptors take turns in picking these up.
+ */
+void connection_queue(connection_t *con)
+{
+    client_queue_t *node = connection_client_node(con);
+
+    if (node)
+        _acceptor_hand_over(node);
+}
+
+static void _client_node_free(client_queue_t *node)
+{
+    client_destroy(node->client);
+    free(node->shoutcast_mount);
+    free(node);
+}
+
+/* give a client to the next acceptor, from a thread other than the acceptors */
+static void _acceptor_hand_over(client_queue_t *node)
+{
+    thread_spin_lock(&_connection_lock);
+    if (_acceptor_count) {
+        acceptor_t *acceptor = &_acceptors[_next_acceptor++ % _acceptor_count];
+
+        node->next = acceptor->incoming;
+        acceptor->incoming = node;
+        pollset_wakeup(acceptor->pollset);
+        node = NULL;
+    }
+    thread_spin_unlock(&_connection_lock);
+
+    if (node) {
+        /* not accepting any more */
+        _client_node_free(node);
+    }
+}
+
+
+/* hand a client to a handshake thread, returns -1 if there are none and
+ * the handshake is left to the reads of the request */
+static int _handshake_queue(client_queue_t *node)
+{
+    handshaker_t *handshaker;
+
+    if (_handshaker_count == 0)
+        return -1;
+
+    gettimeofday(&node->handshake_start, NULL);
+    node->handshake_events = 0;
+
+    thread_spin_lock(&_handshake_lock);
+    handshaker = &_handshakers[_next_handshaker++ % _handshaker_count];
+    node->next = handshaker->incoming;
+    handshaker->incoming = node;
+    pollset_wakeup(handshaker->pollset);
+    thread_spin_unlock(&_handshake_lock);
+    return 0;
+}
+
+static void _handshake_account(client_queue_t *node, int result)
+{
+    struct timeval now;
+    unsigned long took;
+    int resumed = 0;
+
+    gettimeofday(&now, NULL);
+    took = (now.tv_sec - node->handshake_start.tv_sec) * 1000000L + (now.tv_usec - node->handshake_start.tv_usec);
+    if ((long)took < 0)
+        took = 0;
+    if (result > 0)
+        resumed = tls_session_reused(node->client->con->tls) > 0;
+
+    thread_spin_lock(&_handshake_lock);
+    if (result > 0) {
+        _tls_handshakes++;
+        if (resumed)
+            _tls_resumed++;
+        _tls_time_total += took;
+        _tls_time_count++;
+        if (took > _tls_time_max)
+            _tls_time_max = took;
+    } else {
+        _tls_failed++;
+    }
+    thread_spin_unlock(&_handshake_lock);
+}
+
+/* take a client off the pending list, node_ref is the link pointing at it */
+static void _handshake_finish(handshaker_t *handshaker, client_queue_t **node_ref, int result)
+{
+    client_queue_t *node = *node_ref;
+
+    *node_ref = node->next;
+    node->next = NULL;
+    timerwheel_remove(&node->header_timer);
+    if (node->handshake_events)
+        pollset_remove(handshaker->pollset, node->client->con->sock);
+    node->handshake_events = 0;
+
+    _handshake_account(node, result);
+    if (result > 0)
+        _acceptor_hand_over(node);
+    else
+        _client_node_free(node);
+}
+
+/* continue the handshakes which can make progress and drop those which
+ * failed or took longer than the header timeout */
+static void _handshake_pending(handshaker_t *handshaker)
+{
+    client_queue_t **node_ref = &handshaker->pending;
+
+    timerwheel_advance(handshaker->timers, time(NULL));
+
+    while (*node_ref) {
+        client_queue_t *node = *node_ref;
+        connection_t *con = node->client->con;
+        unsigned int events;
+        int ret;
+
+        if (node->timed_out) {
+            _handshake_finish(handshaker, node_ref, -1);
+            continue;
+        }
+        if (node->ready == 0) {
+            node_ref = &node->next;
+            continue;
+        }
+        node->ready = 0;
+        ret = tls_handshake(con->tls);
+        if (ret != 0) {
+            _handshake_finish(handshaker, node_ref, ret);
+            continue;
+        }
+
+        events = tls_want_write(con->tls) > 0 ? POLLSET_WRITE : POLLSET_READ;
+        if (events != node->handshake_events) {
+            if (node->handshake_events)
+                ret = pollset_modify(handshaker->pollset, con->sock, events, node);
+            else
+                ret = pollset_add(handshaker->pollset, con->sock, events, node);
+            if (ret < 0) {
+                _handshake_finish(handshaker, node_ref, -1);
+                continue;
+            }
+            node->handshake_events = events;
+        }
+        node_ref = &node->next;
+    }
+}
+
+static void *_handshaker_thread(void *arg)
+{
+    handshaker_t *handshaker = arg;
+    pollset_event_t events[ACCEPTOR_EVENTS];
+    client_queue_t *node;
+
+    while (_handshakers_running) {
+        ice_config_t *config;
+        int i, count, timeout;
+
+        count = pollset_wait(handshaker->pollset, events, ACCEPTOR_EVENTS, 500);
+        for (i = 0; i < count; i++) {
+            if (events[i].userdata)
+                ((client_queue_t *)events[i].userdata)->ready = 1;
+        }
+
+        config = config_get_config();
+        timeout = config->header_timeout;
+        config_release_config();
+
+        /* new clients get a first try straight away */
+        thread_spin_lock(&_handshake_lock);
+        node = handshaker->incoming;
+        handshaker->incoming = NULL;
+        thread_spin_unlock(&_handshake_lock);
+        while (node) {
+            client_queue_t *next = node->next;
+
+            node->ready = 1;
+            node->next = handshaker->pending;
+            handshaker->pending = node;
+            _header_timer_arm(handshaker->timers, node, timeout);
+            node = next;
+        }
+
+        _handshake_pending(handshaker);
+    }
+
+    while (handshaker->pending)
+        _handshake_finish(handshaker, &handshaker->pending, -1);
+    thread_spin_lock(&_handshake_lock);
+    node = handshaker->incoming;
+    handshaker->incoming = NULL;
+    thread_spin_unlock(&_handshake_lock);
+    while (node) {
+        client_queue_t *next = node->next;
+
+        _client_node_free(node);
+        node = next;
+    }
+    return NULL;
+}
+
+/* start the handshake threads, without any the acceptors do the
+ * handshakes while reading requests */
+static void _handshakers_start(unsigned int count)
+{
+    unsigned int started = 0;
+
+    if (count == 0)
+        return;
+    _handshakers = calloc(count, sizeof(handshaker_t));
+    if (_handshakers == NULL)
+        return;
+
+    _handshakers_running = 1;
+    while (started < count) {
+        handshaker_t *handshaker = &_handshakers[started];
+
+        handshaker->pollset = pollset_new();
+        handshaker->timers = timerwheel_new(time(NULL));
+        if (handshaker->pollset == NULL || handshaker->timers == NULL || pollset_wakeup_enable(handshaker->pollset) < 0)
+            break;
+        handshaker->thread = thread_create("TLS Handshake Thread", _handshaker_thread, handshaker, THREAD_ATTACHED);
+        if (handshaker->thread == NULL)
+            break;
+        started++;
+    }
+    if (started < count) {
+        pollset_free(_handshakers[started].pollset);
+        _handshakers[started].pollset = NULL;
+        timerwheel_free(_handshakers[started].timers);
+        _handshakers[started].timers = NULL;
+        ICECAST_LOG_WARN("Started %u of %u TLS handshake threads", started, count);
+    }
+
+    thread_spin_lock(&_handshake_lock);
+    _handshaker_count = started;
+    thread_spin_unlock(&_handshake_lock);
+}
+
+/* called once the acceptors stopped, so nothing is handed over any more */
+static void _handshakers_stop(void)
+{
+    unsigned int i, count = _handshaker_count;
+
+    _handshakers_running = 0;
+    for (i = 0; i < count; i++)
+        pollset_wakeup(_handshakers[i].pollset);
+    for (i = 0; i < count; i++) {
+        thread_join(_handshakers[i].thread);
+        pollset_free(_handshakers[i].pollset);
+        timerwheel_free(_handshakers[i].timers);
+    }
+
+    thread_spin_lock(&_handshake_lock);
+    _handshaker_count = 0;
+    thread_spin_unlock(&_handshake_lock);
+    free(_handshakers);
+    _handshakers = NULL;
+}
+
+/* wait on the pollset for listening sockets to accept from and requests
+ * to read from. Returns the number of connections accepted.
+ */
+static int acceptor_poll(acceptor_t *acceptor, int timeout)
+{
+    pollset_event_t events[ACCEPTOR_EVENTS];
+    int i, count, accepted = 0;
+
+    count = pollset_wait(acceptor->pollset, events, ACCEPTOR_EVENTS, timeout);
+    for (i = 0; i < count; i++) {
+        sock_t *sock = events[i].userdata;
+
+        if (sock == NULL)
+            continue; /* woken up for clients handed over */
+        /* listening sockets are registered with their slot as userdata */
+        if (sock >= acceptor->socks && sock < acceptor->socks + acceptor->count) {
+            int idx = sock - acceptor->socks;
+
+            if (events[i].events & POLLSET_ERROR)
+                acceptor_close_socket(acceptor, idx, 1);
+            else
+                accepted += _accept_connections(acceptor, idx);
+            continue;
+        }
+        ((client_queue_t *)events[i].userdata)->ready = 1;
+    }
+    return accepted;
+}
+
+static void _acceptor_run(acceptor_t *acceptor)
+{
+    int ready [acceptor->count > 0 ? acceptor->count : 1];
+    int duration = 300;
+    pollset_t *pollset;
+
+    acceptor->timers = timerwheel_new(time(NULL));
+    if (acceptor->timers == NULL) {
+        ICECAST_LOG_ERROR("Unable to set up timers for acceptor %u", acceptor->id);
+        return;
+    }
+    pollset = pollset_new();
+    if (pollset) {
+        int i;
+
+        pollset_wakeup_enable(pollset);
+        for (i = 0; i < acceptor->count; i++) {
+            if (acceptor->socks[i] != SOCK_ERROR)
+                pollset_add(pollset, acceptor->socks[i], POLLSET_READ, &acceptor->socks[i]);
+        }
+    }
+    thread_spin_lock(&_connection_lock);
+    acceptor->pollset = pollset;
+    thread_spin_unlock(&_connection_lock);
+
+    while (global.running == ICECAST_RUNNING) {
+        ice_config_t *config;
+        int i, found, accepted = 0;
+
+        config = config_get_config();
+        acceptor->header_timeout = config->header_timeout;
+        config_release_config();
+
+        if (pollset) {
+            accepted = acceptor_poll(acceptor, duration);
+        } else {
+            found = wait_for_serversock(acceptor, duration, ready);
+            for (i = 0; i < found; i++)
+                accepted += _accept_connections(acceptor, ready[i]);
+        }
+
+        if (accepted && pollset == NULL) {
+            duration = 5; /* without a pollset requests are only looked at in between */
+        } else {
+            if (acceptor->req_queue == NULL)
+                duration = 300; /* use longer timeouts when nothing waiting */
+        }
+        _take_incoming(acceptor);
+        process_request_queue(acceptor);
+    }
+
+    thread_spin_lock(&_connection_lock);
+    acceptor->pollset = NULL;
+    thread_spin_unlock(&_connection_lock);
+    pollset_free(pollset);
+    timerwheel_free(acceptor->timers);
+    acceptor->timers = NULL;
+}
+
+static void *_acceptor_thread(void *arg)
+{
+    _acceptor_run((acceptor_t *)arg);
+    return NULL;
 }
 
 void connection_accept_loop(void)
 {
-    connection_t *con;
     ice_config_t *config;
-    int duration = 300;
+    workqueue_t *queue;
+    unsigned int i, threads, handshake_threads;
 
     config = config_get_config();
     get_tls_certificate(config);
+    threads = config->request_threads;
+    handshake_threads = tls_ok ? config->tls_handshake_threads : 0;
     config_release_config();
 
-    while (global.running == ICECAST_RUNNING) {
-        con = _accept_connection (duration);
+    _handshakers_start(handshake_threads);
 
-        if (con) {
-            connection_queue(con);
-            duration = 5;
-        } else {
-            if (_req_queue == NULL)
-                duration = 300; /* use longer timeouts when nothing waiting */
+    if (threads) {
+        thread_rwlock_wlock(&_request_lock);
+        _request_queue = workqueue_new("Request Thread", threads, REQUEST_QUEUE_LIMIT);
+        thread_rwlock_unlock(&_request_lock);
+    }
+
+    /* acceptor 0 runs in this thread */
+    for (i = 1; i < _acceptor_count; i++) {
+        acceptor_t *acceptor = &_acceptors[i];
+
+        acceptor->thread = thread_create("Acceptor Thread", _acceptor_thread, acceptor, THREAD_ATTACHED);
+        if (acceptor->thread == NULL) {
+            int s;
+
+            /* leaving the sockets open would strand the connections the
+             * kernel hands to them */
+            ICECAST_LOG_ERROR("Unable to start acceptor thread %u", i);
+            for (s = 0; s < acceptor->count; s++) {
+                if (acceptor->socks[s] != SOCK_ERROR)
+                    sock_close(acceptor->socks[s]);
+                acceptor->socks[s] = SOCK_ERROR;
+            }
         }
-        process_request_queue();
     }
+    if (_acceptor_count)
+        _acceptor_run(&_acceptors[0]);
+
+    for (i = 1; i < _acceptor_count; i++) {
+        if (_acceptors[i].thread)
+            thread_join(_acceptors[i].thread);
+    }
+    _handshakers_stop();
+
+    /* later requests, eg from authentication threads, are handled directly */
+    thread_rwlock_wlock(&_request_lock);
+    queue = _request_queue;
+    _request_queue = NULL;
+    thread_rwlock_unlock(&_request_lock);
+    workqueue_free(queue);
 
     /* Give all the other threads notification to shut down */
     thread_cond_broadcast(&global.shutdown_cond);
@@ -854,9 +1631,7 @@ static int __add_listener_to_source(source_t *source, client_t *client)
     memset(client->refbuf->data, 0, PER_CLIENT_REFBUF_SIZE);
 
     /* lets add the client to the active list */
-    avl_tree_wlock(source->pending_tree);
-    avl_insert(source->pending_tree, client);
-    avl_tree_unlock(source->pending_tree);
+    source_add_pending(source, client);
 
     if (source->running == 0 && source->on_demand) {
         /* enable on-demand relay to start, wake up the slave thread */
@@ -871,6 +1646,7 @@ static int __add_listener_to_source(source_t *source, client_t *client)
 static inline ssize_t __count_user_role_on_mount (source_t *source, client_t *client) {
     ssize_t ret = 0;
     avl_node *node;
+    client_t *existing;
 
     avl_tree_rlock(source->client_tree);
     node = avl_get_first(source->client_tree);
@@ -884,24 +1660,170 @@ static inline ssize_t __count_user_role_on_mount (source_t *source, client_t *cl
         }
         node = avl_get_next(node);
     }
-    avl_tree_unlock(source->client_tree);
 
-    avl_tree_rlock(source->pending_tree);
-    node = avl_get_first(source->pending_tree);
-    while (node) {
-        client_t *existing_client = (client_t *)node->key;
-        if (existing_client->username && client->username &&
-            strcmp(existing_client->username, client->username) == 0 &&
-            existing_client->role && client->role &&
-            strcmp(existing_client->role, client->role) == 0){
+    /* the pending list is only taken apart with the client tree write locked */
+    for (existing = source_first_pending(source); existing; existing = existing->pending_next) {
+        if (existing->username && client->username &&
+            strcmp(existing->username, client->username) == 0 &&
+            existing->role && client->role &&
+            strcmp(existing->role, client->role) == 0){
             ret++;
         }
-        node = avl_get_next(node);
     }
-    avl_tree_unlock(source->pending_tree);
+    avl_tree_unlock(source->client_tree);
     return ret;
 }
 
+static void _request_run(request_type_t type, client_t *client, char *uri)
+{
+    switch (type) {
+        case REQUEST_ADMIN:
+            admin_handle_request(client, uri);
+        break;
+        case REQUEST_XSLT:
+            stats_transform_xslt(client, uri);
+        break;
+        case REQUEST_FILE:
+            fserve_client_create(client, uri);
+        break;
+    }
+}
+
+static void _request_job(void *arg)
+{
+    request_job_t *job = arg;
+
+    _request_run(job->type, job->client, job->uri);
+    free(job->uri);
+    free(job);
+}
+
+/* hand the request to the pool, or handle it here if there is none */
+static void _request_dispatch(request_type_t type, client_t *client, const char *uri)
+{
+    request_job_t *job;
+    int queued = -1;
+
+    thread_rwlock_rlock(&_request_lock);
+    if (_request_queue == NULL) {
+        thread_rwlock_unlock(&_request_lock);
+        _request_run(type, client, (char *)uri);
+        return;
+    }
+    job = calloc(1, sizeof(request_job_t));
+    if (job) {
+        job->type = type;
+        job->client = client;
+        job->uri = strdup(uri);
+        if (job->uri)
+            queued = workqueue_add(_request_queue, _request_job, job);
+    }
+    thread_rwlock_unlock(&_request_lock);
+
+    if (queued < 0) {
+        if (job) {
+            free(job->uri);
+            free(job);
+        }
+        thread_spin_lock(&_connection_lock);
+        _request_rejected++;
+        thread_spin_unlock(&_connection_lock);
+        client_send_error_by_id(client, ICECAST_ERROR_CON_REQUEST_QUEUE_FULL);
+    }
+}
+
+/* publish how the request pool is keeping up */
+void connection_stats(void)
+{
+    unsigned int depth;
+    unsigned long wait_avg, wait_max, rejected;
+    unsigned long admission[ADMISSION_CLASSES * 2 + 1];
+    unsigned long handshakes[3], handshake_avg, handshake_max;
+    unsigned int handshakers;
+    uint64_t limited = 0;
+    char name[40];
+    int i;
+
+    /* the sockets do not change while the server runs */
+    for (i = 0; _ratelimits && i < global.server_sockets; i++)
+        limited += ratelimit_dropped(_ratelimits[i]);
+    if (limited != _ratelimit_reported)
+        stats_event_args(NULL, "connections_rate_limited", "%llu", (unsigned long long)limited);
+    _ratelimit_reported = limited;
+
+    thread_spin_lock(&_connection_lock);
+    for (i = 0; i < ADMISSION_CLASSES; i++) {
+        admission[i*2] = _admission_admitted[i];
+        admission[i*2+1] = _admission_rejected[i];
+    }
+    admission[ADMISSION_CLASSES * 2] = _admission_early;
+    thread_spin_unlock(&_connection_lock);
+
+    /* only this thread looks at what was reported */
+    for (i = 0; i < ADMISSION_CLASSES * 2 + 1; i++) {
+        if (admission[i] == _admission_reported[i])
+            continue;
+        if (i == ADMISSION_CLASSES * 2)
+            snprintf(name, sizeof(name), "admission_early_rejected");
+        else
+            snprintf(name, sizeof(name), "admission_%s_%s", _admission_names[i/2], (i & 1) ? "rejected" : "admitted");
+        stats_event_args(NULL, name, "%lu", admission[i]);
+        _admission_reported[i] = admission[i];
+    }
+
+    thread_spin_lock(&_handshake_lock);
+    handshakers = _handshaker_count;
+    handshakes[0] = _tls_handshakes;
+    handshakes[1] = _tls_resumed;
+    handshakes[2] = _tls_failed;
+    handshake_avg = _tls_time_count ? _tls_time_total / _tls_time_count : 0;
+    handshake_max = _tls_time_max;
+    _tls_time_total = _tls_time_count = _tls_time_max = 0;
+    thread_spin_unlock(&_handshake_lock);
+
+    if (handshakers) {
+        if (handshakes[0] != _tls_reported[0] || handshakes[1] != _tls_reported[1]) {
+            stats_event_args(NULL, "tls_handshakes", "%lu", handshakes[0]);
+            stats_event_args(NULL, "tls_handshakes_resumed", "%lu", handshakes[1]);
+            stats_event_args(NULL, "tls_resumption_rate", "%lu", handshakes[1] * 100 / handshakes[0]);
+        }
+        if (handshakes[2] != _tls_reported[2])
+            stats_event_args(NULL, "tls_handshakes_failed", "%lu", handshakes[2]);
+        if (handshake_avg != _tls_time_reported[0])
+            stats_event_args(NULL, "tls_handshake_time_avg", "%lu", handshake_avg);
+        if (handshake_max != _tls_time_reported[1])
+            stats_event_args(NULL, "tls_handshake_time_max", "%lu", handshake_max);
+        memcpy(_tls_reported, handshakes, sizeof(_tls_reported));
+        _tls_time_reported[0] = handshake_avg;
+        _tls_time_reported[1] = handshake_max;
+    }
+
+    thread_rwlock_rlock(&_request_lock);
+    if (_request_queue == NULL) {
+        thread_rwlock_unlock(&_request_lock);
+        return;
+    }
+    workqueue_get_stats(_request_queue, &depth, &wait_avg, &wait_max);
+    thread_rwlock_unlock(&_request_lock);
+
+    thread_spin_lock(&_connection_lock);
+    rejected = _request_rejected;
+    thread_spin_unlock(&_connection_lock);
+
+    if (depth != _request_depth_reported)
+        stats_event_args(NULL, "request_queue_depth", "%u", depth);
+    _request_depth_reported = depth;
+    if (wait_avg != _request_wait_reported[0])
+        stats_event_args(NULL, "request_wait_avg", "%lu", wait_avg);
+    if (wait_max != _request_wait_reported[1])
+        stats_event_args(NULL, "request_wait_max", "%lu", wait_max);
+    _request_wait_reported[0] = wait_avg;
+    _request_wait_reported[1] = wait_max;
+    if (rejected != _request_rejected_reported)
+        stats_event_args(NULL, "request_queue_rejected", "%lu", rejected);
+    _request_rejected_reported = rejected;
+}
+
 static void _handle_get_request(client_t *client, char *uri) {
     source_t *source = NULL;
 
@@ -918,12 +1840,12 @@ static void _handle_get_request(client_t *client, char *uri) {
     /* Dispatch legacy admin.cgi requests */
     if (strcmp(uri, "/admin.cgi") == 0) {
         ICECAST_LOG_DEBUG("Client %p requesting admin interface.", client);
-        admin_handle_request(client, uri + 1);
+        _request_dispatch(REQUEST_ADMIN, client, uri + 1);
         return;
     } /* Dispatch all admin requests */
     else if (strncmp(uri, "/admin/", 7) == 0) {
         ICECAST_LOG_DEBUG("Client %p requesting admin interface.", client);
-        admin_handle_request(client, uri + 7);
+        _request_dispatch(REQUEST_ADMIN, client, uri + 7);
         return;
     }
 
@@ -941,7 +1863,7 @@ static void _handle_get_request(client_t *client, char *uri) {
     if (util_check_valid_extension(uri) == XSLT_CONTENT) {
         /* If the file exists, then transform it, otherwise, write a 404 */
         ICECAST_LOG_DEBUG("Stats request, sending XSL transformed stats");
-        stats_transform_xslt(client, uri);
+        _request_dispatch(REQUEST_XSLT, client, uri);
         return;
     }
 
@@ -982,11 +1904,11 @@ static void _handle_get_request(client_t *client, char *uri) {
     } else {
         /* file */
         avl_tree_unlock(global.source_tree);
-        fserve_client_create(client, uri);
+        _request_dispatch(REQUEST_FILE, client, uri);
     }
 }
 
-static void _handle_shoutcast_compatible(client_queue_t *node)
+static void _handle_shoutcast_compatible(acceptor_t *acceptor, client_queue_t *node)
 {
     char *http_compliant;
     int http_compliant_len = 0;
@@ -1029,8 +1951,9 @@ static void _handle_shoutcast_compatible(client_queue_t *node)
         node->offset -= (headers - client->refbuf->data);
         memmove(client->refbuf->data, headers, node->offset+1);
         node->shoutcast = 2;
+        header_scan_reset(node);
         /* we've checked the password, now send it back for reading headers */
-        _add_request_queue(node);
+        _add_request_queue(acceptor, node);
         return;
     }
     /* actually make a copy as we are dropping the config lock */
@@ -1296,21 +2219,21 @@ static void __prepare_shoutcast_admin_cgi_request(client_t *client)
  * the contents provided. We set up the parser then hand off to the specific
  * request handler.
  */
-static void _handle_connection(void)
+static void _handle_connection(acceptor_t *acceptor)
 {
     http_parser_t *parser;
     const char *rawuri;
     client_queue_t *node;
 
     while (1) {
-        node = _get_connection();
+        node = _get_connection(acceptor);
         if (node) {
             client_t *client = node->client;
             int already_parsed = 0;
 
             /* Check for special shoutcast compatability processing */
             if (node->shoutcast) {
-                _handle_shoutcast_compatible (node);
+                _handle_shoutcast_compatible (acceptor, node);
                 if (node->shoutcast)
                     continue;
             }
@@ -1393,6 +2316,11 @@ static void _handle_connection(void)
                     client->admin_command = admin_get_command(uri + 7);
                 }
 
+                if (_admission_check(client, uri) < 0) {
+                    free(uri);
+                    continue;
+                }
+
                 _handle_authentication(client, uri);
             } else {
                 free (node);
@@ -1406,18 +2334,134 @@ static void _handle_connection(void)
 }
 
 
+#ifdef SO_REUSEPORT
+/* like sock_get_server_socket() but lets several sockets bind the same
+ * address, one for each acceptor */
+static sock_t connection_reuseport_socket(int port, const char *bind_address)
+{
+    struct addrinfo hints, *res, *ai;
+    char service[10];
+    sock_t sock = SOCK_ERROR;
+    int pass;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if (getaddrinfo(bind_address, service, &hints, &res) != 0)
+        return SOCK_ERROR;
+
+    /* prefer IPv6 which also takes IPv4 connections, like the common code */
+    for (pass = 0; pass < 2 && sock == SOCK_ERROR; pass++) {
+        for (ai = res; ai; ai = ai->ai_next) {
+            int on = 1;
+
+            if ((ai->ai_family == AF_INET6) != (pass == 0))
+                continue;
+            sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (sock == SOCK_ERROR)
+                continue;
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const void *)&on, sizeof(on));
+            setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const void *)&on, sizeof(on));
+#ifdef IPV6_V6ONLY
+            if (ai->ai_family == AF_INET6) {
+                int off = 0;
+                setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const void *)&off, sizeof(off));
+            }
+#endif
+            if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+                break;
+            sock_close(sock);
+            sock = SOCK_ERROR;
+        }
+    }
+    freeaddrinfo(res);
+    return sock;
+}
+#endif
+
+static sock_t connection_listen_socket(listener_t *listener, int reuseport)
+{
+    sock_t sock;
+
+#ifdef SO_REUSEPORT
+    if (reuseport)
+        sock = connection_reuseport_socket (listener->port, listener->bind_address);
+    else
+#endif
+        sock = sock_get_server_socket (listener->port, listener->bind_address);
+    if (sock == SOCK_ERROR)
+        return SOCK_ERROR;
+    if (sock_listen (sock, ICECAST_LISTEN_QUEUE) == SOCK_ERROR) {
+        sock_close (sock);
+        return SOCK_ERROR;
+    }
+    /* some win32 setups do not do TCP win scaling well, so allow an override */
+    if (listener->so_sndbuf)
+        sock_set_send_buffer (sock, listener->so_sndbuf);
+    sock_set_blocking (sock, 0);
+    return sock;
+}
+
+/* close the sockets of all but the first acceptor, which uses the ones in
+ * global.serversock, and drop the acceptors.
+ */
+static void connection_free_acceptors(void)
+{
+    acceptor_t *acceptors;
+    unsigned int count, i;
+    int s;
+
+    thread_spin_lock(&_connection_lock);
+    acceptors = _acceptors;
+    count = _acceptor_count;
+    _acceptors = NULL;
+    _acceptor_count = 0;
+    thread_spin_unlock(&_connection_lock);
+
+    for (i = 0; i < count; i++) {
+        client_queue_t *node = acceptors[i].incoming;
+
+        while (node) {
+            client_queue_t *next = node->next;
+
+            client_destroy(node->client);
+            free(node->shoutcast_mount);
+            free(node);
+            node = next;
+        }
+        if (i > 0) {
+            for (s = 0; s < acceptors[i].count; s++)
+                if (acceptors[i].socks[s] != SOCK_ERROR)
+                    sock_close (acceptors[i].socks[s]);
+            free (acceptors[i].socks);
+        }
+    }
+    free (acceptors);
+}
+
 /* called when listening thread is not checking for incoming connections */
 int connection_setup_sockets (ice_config_t *config)
 {
     int count = 0;
+    unsigned int acceptors, i;
     listener_t *listener, **prev;
+    sock_t *extra;
 
+    connection_free_acceptors();
     global_lock();
     if (global.serversock) {
-        for (; count < global.server_sockets; count++)
+        for (; count < global.server_sockets; count++) {
             sock_close (global.serversock [count]);
+            if (_ratelimits)
+                ratelimit_free (_ratelimits [count]);
+        }
         free (global.serversock);
         global.serversock = NULL;
+        free (_ratelimits);
+        _ratelimits = NULL;
     }
     if (config == NULL) {
         global_unlock();
@@ -1437,31 +2481,26 @@ int connection_setup_sockets (ice_config_t *config)
         allowed_ip = matchfile_new(config->allowfile);
     }
 
+    acceptors = config->acceptor_threads ? config->acceptor_threads : 1;
+#ifndef SO_REUSEPORT
+    if (acceptors > 1) {
+        ICECAST_LOG_WARN("SO_REUSEPORT is not available, using a single acceptor thread");
+        acceptors = 1;
+    }
+#endif
+
     count = 0;
     global.serversock = calloc(config->listen_sock_count, sizeof(sock_t));
+    _ratelimits = calloc(config->listen_sock_count, sizeof(ratelimit_t *));
+    /* sockets of acceptor n are at extra[(n-1)*listen_sock_count + listener] */
+    extra = calloc((acceptors - 1) * config->listen_sock_count + 1, sizeof(sock_t));
 
     listener = config->listen_sock;
     prev = &config->listen_sock;
     while (listener) {
-        int successful = 0;
+        sock_t sock = connection_listen_socket (listener, acceptors > 1);
 
-        do {
-            sock_t sock = sock_get_server_socket (listener->port, listener->bind_address);
-            if (sock == SOCK_ERROR)
-                break;
-            if (sock_listen (sock, ICECAST_LISTEN_QUEUE) == SOCK_ERROR) {
-                sock_close (sock);
-                break;
-            }
-            /* some win32 setups do not do TCP win scaling well, so allow an override */
-            if (listener->so_sndbuf)
-                sock_set_send_buffer (sock, listener->so_sndbuf);
-            sock_set_blocking (sock, 0);
-            successful = 1;
-            global.serversock [count] = sock;
-            count++;
-        } while(0);
-        if (successful == 0) {
+        if (sock == SOCK_ERROR) {
             if (listener->bind_address) {
                 ICECAST_LOG_ERROR("Could not create listener socket on port %d bind %s",
                         listener->port, listener->bind_address);
@@ -1473,6 +2512,17 @@ int connection_setup_sockets (ice_config_t *config)
             listener = *prev;
             continue;
         }
+        global.serversock [count] = sock;
+        _ratelimits [count] = ratelimit_new (listener->connection_rate, listener->connection_burst);
+        for (i = 1; i < acceptors; i++) {
+            sock_t *slot = &extra[(i-1) * config->listen_sock_count + count];
+
+            /* the other acceptors still take this listener if one fails */
+            *slot = connection_listen_socket (listener, 1);
+            if (*slot == SOCK_ERROR)
+                ICECAST_LOG_WARN("Could not create socket on port %d for acceptor %u", listener->port, i);
+        }
+        count++;
         if (listener->bind_address) {
             ICECAST_LOG_INFO("listener socket on port %d address %s", listener->port, listener->bind_address);
         } else {
@@ -1482,10 +2532,30 @@ int connection_setup_sockets (ice_config_t *config)
         listener = listener->next;
     }
     global.server_sockets = count;
+
+    _acceptors = calloc(acceptors, sizeof(acceptor_t));
+    for (i = 0; i < acceptors; i++) {
+        acceptor_t *acceptor = &_acceptors[i];
+
+        acceptor->id = i;
+        acceptor->count = count;
+        if (i == 0) {
+            acceptor->socks = global.serversock;
+        } else {
+            acceptor->socks = calloc(count + 1, sizeof(sock_t));
+            memcpy(acceptor->socks, &extra[(i-1) * config->listen_sock_count], count * sizeof(sock_t));
+        }
+        acceptor->req_queue_tail = &acceptor->req_queue;
+        acceptor->con_queue_tail = &acceptor->con_queue;
+    }
+    _acceptor_count = acceptors;
+    free(extra);
     global_unlock();
 
     if (count == 0)
         ICECAST_LOG_ERROR("No listening sockets established");
+    else if (acceptors > 1)
+        ICECAST_LOG_INFO("%u acceptor threads share the listener sockets", acceptors);
 
     return count;
 }
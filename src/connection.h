@@ -50,12 +50,18 @@ typedef struct connection_tag
     uint64_t sent_bytes;
 
     sock_t sock;
-    sock_t serversock;
+    int listener;           /* index of the listening socket it came in on, -1 if none */
     int error;
 
+    /* set when a send could not complete, only looked at while the socket
+     * is watched for writability, cleared when it is reported writable */
+    int write_watched;
+    int write_blocked;
+
     tlsmode_t tlsmode;
     tls_t *tls;
     int (*send)(struct connection_tag *handle, const void *buf, size_t len);
+    int (*sendv)(struct connection_tag *handle, const struct iovec *iov, size_t count);
     int (*read)(struct connection_tag *handle, void *buf, size_t len);
 
     char *ip;
@@ -65,9 +71,10 @@ void connection_initialize(void);
 void connection_shutdown(void);
 void connection_reread_config(struct ice_config_tag *config);
 void connection_accept_loop(void);
+void connection_stats(void);
 int connection_setup_sockets(struct ice_config_tag *config);
 void connection_close(connection_t *con);
-connection_t *connection_create(sock_t sock, sock_t serversock, char *ip);
+connection_t *connection_create(sock_t sock, int listener, char *ip);
 int connection_complete_source(struct source_tag *source, int response);
 void connection_queue(connection_t *con);
 void connection_uses_tls(connection_t *con);
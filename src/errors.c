@@ -132,7 +132,10 @@ static const icecast_error_t __errors[] = {
      .message = "Could not parse XSLT file"},
     {.id = ICECAST_ERROR_XSLT_problem,                                  .http_status = 500,
      .uuid = "d3c6e4b3-7d6e-4191-a81b-970273067ae3",
-     .message = "XSLT problem"}
+     .message = "XSLT problem"},
+    {.id = ICECAST_ERROR_CON_REQUEST_QUEUE_FULL,                        .http_status = 503,
+     .uuid = "0d9788f1-c884-4e55-8a43-cb4484f6aa66",
+     .message = "Too many requests waiting, try again later"}
 };
 
 const icecast_error_t * error_get_by_id(int id) {
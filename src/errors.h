@@ -48,6 +48,7 @@
 #define ICECAST_ERROR_SOURCE_STREAM_PREPARATION_ERROR          37
 #define ICECAST_ERROR_XSLT_PARSE                               38
 #define ICECAST_ERROR_XSLT_problem                             39
+#define ICECAST_ERROR_CON_REQUEST_QUEUE_FULL                   40
 
 struct icecast_error_tag {
     const int id;
@@ -70,6 +70,12 @@ format_type_t format_get_type (const char *contenttype)
         return FORMAT_TYPE_EBML;
     else if(strcmp(contenttype, "video/x-matroska-3d") == 0)
         return FORMAT_TYPE_EBML;
+    else if(strcmp(contenttype, "audio/aac") == 0)
+        return FORMAT_TYPE_AAC;
+    else if(strcmp(contenttype, "audio/aacp") == 0)
+        return FORMAT_TYPE_AAC;
+    else if(strcmp(contenttype, "audio/x-aac") == 0)
+        return FORMAT_TYPE_AAC;
     else
         /* We default to the Generic format handler, which
            can handle many more formats than just mp3.
@@ -89,6 +95,9 @@ int format_get_plugin(format_type_t type, source_t *source)
         case FORMAT_TYPE_EBML:
             ret = format_ebml_get_plugin(source);
         break;
+        case FORMAT_TYPE_AAC:
+            ret = format_aac_get_plugin(source);
+        break;
         case FORMAT_TYPE_GENERIC:
             ret = format_mp3_get_plugin(source);
         break;
@@ -132,6 +141,8 @@ static void find_client_start(source_t *source, client_t *client)
             client->check_buffer = format_advance_queue;
             client->write_to_client = source->format->write_buf_to_client;
             client->intro_offset = -1;
+            if (source->format->start_client)
+                source->format->start_client (source, client);
             break;
         }
         refbuf = refbuf->next;
@@ -229,6 +240,7 @@ int format_check_http_buffer(source_t *source, client_t *client)
 
     if (client->pos == refbuf->len)
     {
+        client_compact(client);
         client->write_to_client = source->format->write_buf_to_client;
         client->check_buffer = format_check_file_buffer;
         client->intro_offset = 0;
@@ -239,17 +251,70 @@ int format_check_http_buffer(source_t *source, client_t *client)
 }
 
 
+/* is the client following the source queue, so that the blocks queued
+ * after the current one can be sent along with it */
+int format_client_can_gather(client_t *client)
+{
+    return client->check_buffer == format_advance_queue;
+}
+
+
+/* move the client to the given position in the queue, refbuf has to be
+ * the current one or a later one in the queue */
+void format_client_seek(client_t *client, refbuf_t *refbuf, unsigned int pos)
+{
+    if (client->refbuf != refbuf)
+        client_set_queue(client, refbuf);
+    client->pos = pos;
+}
+
+
 int format_generic_write_to_client(client_t *client)
 {
     refbuf_t *refbuf = client->refbuf;
+    struct iovec iov[FORMAT_MAX_IOV];
+    unsigned int count = 0, total = 0;
+    unsigned int pos = client->pos;
     int ret;
-    const char *buf = refbuf->data + client->pos;
-    unsigned int len = refbuf->len - client->pos;
 
-    ret = client_send_bytes(client, buf, len);
+    /* send what is left of this block and as much of the queue following
+     * it as possible in a single call */
+    while (refbuf && count < FORMAT_MAX_IOV && total < FORMAT_GATHER_LIMIT)
+    {
+        if (refbuf->len > pos)
+        {
+            iov[count].iov_base = refbuf->data + pos;
+            iov[count].iov_len = refbuf->len - pos;
+            total += refbuf->len - pos;
+            count++;
+        }
+        if (format_client_can_gather(client) == 0)
+            break;
+        refbuf = refbuf->next;
+        pos = 0;
+    }
+    if (count == 0)
+        return 0;
+    if (count == 1)
+        ret = client_send_bytes(client, iov[0].iov_base, iov[0].iov_len);
+    else
+        ret = client_send_iovec(client, iov, count);
 
     if (ret > 0)
-        client->pos += ret;
+    {
+        unsigned int left = ret;
+
+        /* work out where in the queue the client ended up */
+        refbuf = client->refbuf;
+        pos = client->pos;
+        while (left > refbuf->len - pos && refbuf->next)
+        {
+            left -= refbuf->len - pos;
+            refbuf = refbuf->next;
+            pos = 0;
+        }
+        format_client_seek(client, refbuf, pos + left);
+    }
 
     return ret;
 }
@@ -305,11 +370,10 @@ static int format_prepare_headers (source_t *source, client_t *client)
         client->respcode = 500;
         return -1;
     } else if (((size_t)bytes + (size_t)1024U) >= remaining) { /* we don't know yet how much to follow but want at least 1kB free space */
-        void *new_ptr = realloc(ptr, bytes + 1024);
-        if (new_ptr) {
+        if (refbuf_resize(client->refbuf, bytes + 1024) == 0) {
             ICECAST_LOG_DEBUG("Client buffer reallocation succeeded.");
-            client->refbuf->data = ptr = new_ptr;
-            client->refbuf->len = remaining = bytes + 1024;
+            ptr = client->refbuf->data;
+            remaining = client->refbuf->len;
             bytes = util_http_build_header(ptr, remaining, 0, 0, 200, NULL, source->format->contenttype, NULL, NULL, source, client);
             if (bytes == -1 ) {
                 ICECAST_LOG_ERROR("Dropping client as we can not build response headers.");
@@ -32,6 +32,7 @@ typedef enum _format_type_tag
     FORMAT_ERROR, /* No format, source not processable */
     FORMAT_TYPE_OGG,
     FORMAT_TYPE_EBML,
+    FORMAT_TYPE_AAC,
     FORMAT_TYPE_GENERIC
 } format_type_t;
 
@@ -54,6 +55,9 @@ typedef struct _format_plugin_tag
     void (*set_tag)(struct _format_plugin_tag *plugin, const char *tag, const char *value, const char *charset);
     void (*free_plugin)(struct _format_plugin_tag *self);
     void (*apply_settings)(client_t *client, struct _format_plugin_tag *format, struct _mount_proxy *mount);
+    /* optional, called once a client starting on the stream has been
+     * placed in the source queue, it may move the client on from there */
+    void (*start_client)(struct source_tag *source, client_t *client);
 
     /* meta data */
     vorbis_comment vc;
@@ -66,7 +70,13 @@ format_type_t format_get_type(const char *contenttype);
 char *format_get_mimetype(format_type_t type);
 int format_get_plugin(format_type_t type, struct source_tag *source);
 
+/* limits on how much of the queue is handed to the socket in one call */
+#define FORMAT_MAX_IOV          32
+#define FORMAT_GATHER_LIMIT     65536
+
 int format_generic_write_to_client (client_t *client);
+int format_client_can_gather (client_t *client);
+void format_client_seek (client_t *client, refbuf_t *refbuf, unsigned int pos);
 int format_advance_queue (struct source_tag *source, client_t *client);
 int format_check_http_buffer (struct source_tag *source, client_t *client);
 int format_check_file_buffer (struct source_tag *source, client_t *client);
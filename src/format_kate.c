@@ -149,7 +149,7 @@ static refbuf_t *process_kate_page (ogg_state_t *ogg_info, ogg_codec_t *codec, o
         return NULL;
     }
 
-    refbuf = make_refbuf_with_page (page);
+    refbuf = make_refbuf_with_page (ogg_info, page);
     /* ICECAST_LOG_DEBUG("refbuf %p has pageno %ld, %llu", refbuf, ogg_page_pageno (page), (uint64_t)granulepos); */
 
     if (codec->possible_start)
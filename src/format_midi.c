@@ -50,7 +50,7 @@ static refbuf_t *process_midi_page (ogg_state_t *ogg_info, ogg_codec_t *codec, o
         ogg_info->error = 1;
         return NULL;
     }
-    refbuf = make_refbuf_with_page (page);
+    refbuf = make_refbuf_with_page (ogg_info, page);
     return refbuf;
 }
 
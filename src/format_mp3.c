@@ -14,7 +14,7 @@
 
 /* format_mp3.c
  **
- ** format plugin for mp3
+ ** format plugin for mp3, and AAC in ADTS frames
  **
  */
 
@@ -48,6 +48,17 @@
  */
 #define ICY_METADATA_INTERVAL 16000
 
+/* blocks the source data is read in */
+#define REFBUF_SIZE 1400
+
+/* how often the measured bitrate is reported, in seconds of audio */
+#define MP3_MEASURE_PERIOD 10
+
+/* content types which are cut at MPEG audio frames */
+static const char *mp3_frame_types[] = {
+    "audio/mpeg", "audio/mpg", "audio/mp3", "audio/x-mpeg", "audio/x-mp3", NULL
+};
+
 static void format_mp3_free_plugin(format_plugin_t *self);
 static refbuf_t *mp3_get_filter_meta (source_t *source);
 static refbuf_t *mp3_get_no_meta (source_t *source);
@@ -55,6 +66,8 @@ static refbuf_t *mp3_get_no_meta (source_t *source);
 static int  format_mp3_create_client_data (source_t *source, client_t *client);
 static void free_mp3_client_data (client_t *client);
 static int format_mp3_write_buf_to_client(client_t *client);
+static int mp3_chain_write_to_client (client_t *client);
+static void format_mp3_start_client (source_t *source, client_t *client);
 static void write_mp3_to_file (struct source_tag *source, refbuf_t *refbuf);
 static void mp3_set_tag (format_plugin_t *plugin, const char *tag, const char *in_value, const char *charset);
 static void format_mp3_apply_settings(client_t *client, format_plugin_t *format, mount_proxy *mount);
@@ -66,18 +79,23 @@ typedef struct {
     unsigned int since_meta_block;
     int in_metadata;
     refbuf_t *associated;
+    icychain_t *chain;          /* followed instead of the source queue */
+    uint64_t offset;            /* in the stream, of the next mp3 to send */
+    refbuf_t *join;             /* chain block to move on to */
+    uint64_t join_offset;       /* where in the stream it starts */
 } mp3_client_data;
 
-int format_mp3_get_plugin(source_t *source)
+static int mp3_get_plugin (source_t *source, format_type_t type)
 {
     const char *metadata;
     format_plugin_t *plugin;
     mp3_state *state = calloc(1, sizeof(mp3_state));
     refbuf_t *meta;
+    int i;
 
     plugin = (format_plugin_t *) calloc(1, sizeof(format_plugin_t));
 
-    plugin->type = FORMAT_TYPE_GENERIC;
+    plugin->type = type;
     plugin->get_buffer = mp3_get_no_meta;
     plugin->write_buf_to_client = format_mp3_write_buf_to_client;
     plugin->write_buf_to_file = write_mp3_to_file;
@@ -85,6 +103,7 @@ int format_mp3_get_plugin(source_t *source)
     plugin->free_plugin = format_mp3_free_plugin;
     plugin->set_tag = mp3_set_tag;
     plugin->apply_settings = format_mp3_apply_settings;
+    plugin->start_client = format_mp3_start_client;
 
     plugin->contenttype = httpp_getvar(source->parser, "content-type");
     if (plugin->contenttype == NULL) {
@@ -94,6 +113,20 @@ int format_mp3_get_plugin(source_t *source)
 
     plugin->_state = state;
 
+    if (type == FORMAT_TYPE_AAC)
+    {
+        state->frame_sync = 1;
+        mpeg_sync_init (&state->sync, MPEG_TYPE_ADTS);
+    }
+    for (i = 0; state->frame_sync == 0 && mp3_frame_types[i]; i++)
+    {
+        if (strcasecmp (plugin->contenttype, mp3_frame_types[i]) == 0)
+        {
+            state->frame_sync = 1;
+            mpeg_sync_init (&state->sync, MPEG_TYPE_AUDIO);
+        }
+    }
+
     /* initial metadata needs to be blank for sending to clients and for
        comparing with new metadata */
     meta = refbuf_new (17);
@@ -120,6 +153,16 @@ int format_mp3_get_plugin(source_t *source)
     return 0;
 }
 
+int format_mp3_get_plugin(source_t *source)
+{
+    return mp3_get_plugin (source, FORMAT_TYPE_GENERIC);
+}
+
+int format_aac_get_plugin(source_t *source)
+{
+    return mp3_get_plugin (source, FORMAT_TYPE_AAC);
+}
+
 
 static void mp3_set_tag (format_plugin_t *plugin, const char *tag, const char *in_value, const char *charset)
 {
@@ -310,142 +353,319 @@ static void mp3_set_title(source_t *source)
 }
 
 
-/* send the appropriate metadata, and return the number of bytes written
- * which is 0 or greater.  Check the client in_metadata value afterwards
- * to see if all metadata has been sent
+/* Work out what to send as the metadata block, if there is a change in
+ * metadata then send it else send a single zero value byte in its place.
+ * previous is what the client was last sent, offset is how much of the
+ * block has already been sent.
  */
-static int send_stream_metadata (client_t *client, refbuf_t *associated)
+static char *stream_metadata_block (refbuf_t *associated, refbuf_t *previous,
+        int offset, unsigned int *len)
 {
-    int ret = 0;
-    char *metadata;
-    int meta_len;
-    mp3_client_data *client_mp3 = client->format_data;
+    static char empty_meta[] = "\001StreamTitle='';";
 
-    /* If there is a change in metadata then send it else
-     * send a single zero value byte in its place
-     */
-    if (associated && associated != client_mp3->associated)
+    if (associated && associated != previous)
     {
-        metadata = associated->data + client_mp3->metadata_offset;
-        meta_len = associated->len - client_mp3->metadata_offset;
+        *len = associated->len - offset;
+        return associated->data + offset;
     }
-    else
+    if (associated)
     {
-        if (associated)
-        {
-            metadata = "\0";
-            meta_len = 1;
-        }
-        else
-        {
-            char *meta = "\001StreamTitle='';";
-            metadata = meta + client_mp3->metadata_offset;
-            meta_len = 17 - client_mp3->metadata_offset;
-        }
+        *len = 1;
+        return "\0";
     }
-    ret = client_send_bytes(client, metadata, meta_len);
+    *len = 17 - offset;
+    return empty_meta + offset;
+}
 
-    if (ret == meta_len)
-    {
-        client_mp3->associated = associated;
-        client_mp3->metadata_offset = 0;
-        client_mp3->in_metadata = 0;
-        client_mp3->since_meta_block = 0;
-        return ret;
-    }
-    if (ret > 0)
-        client_mp3->metadata_offset += ret;
-    else
-        ret = 0;
-    client_mp3->in_metadata = 1;
 
-    return ret;
-}
+/* a piece of what is handed to the socket in one go, either mp3 from a
+ * block in the queue or a metadata block in between */
+typedef struct {
+    refbuf_t *refbuf;       /* block the mp3 or metadata belongs to */
+    unsigned int pos;       /* mp3: where in refbuf this piece starts */
+    int metadata_offset;    /* metadata: how much was sent before */
+    int is_metadata;
+} mp3_segment;
 
 
 /* Handler for writing mp3 data to a client, taking into account whether
- * client has requested shoutcast style metadata updates
+ * client has requested shoutcast style metadata updates. As much of the
+ * queue as possible is gathered with the metadata blocks in place, and
+ * the client state is then moved on by whatever the socket took.
  */
 static int format_mp3_write_buf_to_client(client_t *client)
 {
-    int ret, written = 0;
     mp3_client_data *client_mp3 = client->format_data;
+    struct iovec iov[FORMAT_MAX_IOV];
+    mp3_segment segments[FORMAT_MAX_IOV];
     refbuf_t *refbuf = client->refbuf;
-    char *buf = refbuf->data + client->pos;
-    unsigned int len = refbuf->len - client->pos;
+    refbuf_t *associated = client_mp3->associated;
+    unsigned int pos = client->pos, since = client_mp3->since_meta_block;
+    unsigned int count = 0, total = 0, left, i;
+    int metadata_offset = client_mp3->metadata_offset;
+    uint64_t offset = client_mp3->offset;
+    int ret;
+
+    /* on to the chain once the listener has got to where it was to join,
+     * unless it has been moved off the source queue meanwhile */
+    if (client_mp3->join && (format_client_can_gather (client) == 0 || offset > client_mp3->join_offset))
+    {
+        refbuf_release (client_mp3->join);
+        client_mp3->join = NULL;
+    }
+    if (client_mp3->join && offset == client_mp3->join_offset && since == 0 && client_mp3->in_metadata == 0)
+    {
+        client_set_queue (client, client_mp3->join);
+        refbuf_release (client_mp3->join);
+        client_mp3->join = NULL;
+        client->write_to_client = mp3_chain_write_to_client;
+        return mp3_chain_write_to_client (client);
+    }
 
-    do
+    /* unwritten metadata is picked up here as well, it is only left
+     * pending once the interval has been reached */
+    if (client_mp3->in_metadata)
+        since = client_mp3->interval;
+
+    while (count < FORMAT_MAX_IOV && total < FORMAT_GATHER_LIMIT)
     {
-        /* send any unwritten metadata to the client */
-        if (client_mp3->in_metadata)
-        {
-            refbuf_t *associated = refbuf->associated;
-            ret = send_stream_metadata(client, associated);
+        mp3_segment *segment = &segments[count];
+        unsigned int len;
 
-            if (client_mp3->in_metadata)
-                break;
-            written += ret;
-        }
         /* see if we need to send the current metadata to the client */
-        if (client_mp3->interval)
+        if (client_mp3->interval && since == client_mp3->interval)
         {
-            unsigned int remaining = client_mp3->interval -
-                client_mp3->since_meta_block;
-
-            /* leading up to sending the metadata block */
-            if (remaining <= len)
-            {
-                /* send any mp3 before the metadata block */
-                if (remaining)
-                {
-                    ret = client_send_bytes (client, buf, remaining);
-
-                    if (ret > 0)
-                    {
-                        client_mp3->since_meta_block += ret;
-                        client->pos += ret;
-                    }
-                    if (ret < (int)remaining)
-                        break;
-                    written += ret;
-                }
-                ret = send_stream_metadata (client, refbuf->associated);
-                if (client_mp3->in_metadata)
-                    break;
-                written += ret;
-                buf += remaining;
-                len -= remaining;
-                /* limit how much mp3 we send if using small intervals */
-                if (len > client_mp3->interval)
-                    len = client_mp3->interval;
-            }
+            iov[count].iov_base = stream_metadata_block (refbuf->associated,
+                    associated, metadata_offset, &len);
+            iov[count].iov_len = len;
+            segment->refbuf = refbuf;
+            segment->metadata_offset = metadata_offset;
+            segment->is_metadata = 1;
+            associated = refbuf->associated;
+            metadata_offset = 0;
+            since = 0;
+            total += len;
+            count++;
+            continue;
         }
-        /* write any mp3, maybe after the metadata block */
-        if (len)
+        /* stop where the listener is to join a chain */
+        if (client_mp3->join && since == 0 && offset == client_mp3->join_offset)
+            break;
+        if (pos == refbuf->len)
         {
-            ret = client_send_bytes (client, buf, len);
+            if (refbuf->next == NULL || format_client_can_gather (client) == 0)
+                break;
+            refbuf = refbuf->next;
+            pos = 0;
+            continue;
+        }
+        /* any mp3 up to the next metadata block */
+        len = refbuf->len - pos;
+        if (client_mp3->interval && len > client_mp3->interval - since)
+            len = client_mp3->interval - since;
+        iov[count].iov_base = refbuf->data + pos;
+        iov[count].iov_len = len;
+        segment->refbuf = refbuf;
+        segment->pos = pos;
+        segment->is_metadata = 0;
+        pos += len;
+        offset += len;
+        since += len;
+        total += len;
+        count++;
+    }
+    if (count == 0)
+        return 0;
+
+    if (count == 1)
+        ret = client_send_bytes (client, iov[0].iov_base, iov[0].iov_len);
+    else
+        ret = client_send_iovec (client, iov, count);
 
-            if (ret > 0)
+    /* now move the client on by what was actually written */
+    left = ret > 0 ? ret : 0;
+    for (i = 0; i < count; i++)
+    {
+        mp3_segment *segment = &segments[i];
+        unsigned int sent = left < iov[i].iov_len ? left : iov[i].iov_len;
+
+        left -= sent;
+        if (segment->is_metadata)
+        {
+            if (sent < iov[i].iov_len)
             {
-                client_mp3->since_meta_block += ret;
-                client->pos += ret;
-            }
-            if (ret < (int)len)
+                client_mp3->metadata_offset = segment->metadata_offset + sent;
+                client_mp3->in_metadata = 1;
                 break;
-            written += ret;
+            }
+            client_mp3->associated = segment->refbuf->associated;
+            client_mp3->metadata_offset = 0;
+            client_mp3->in_metadata = 0;
+            client_mp3->since_meta_block = 0;
+            continue;
+        }
+        if (sent)
+        {
+            client_mp3->since_meta_block += sent;
+            client_mp3->offset += sent;
+            format_client_seek (client, segment->refbuf, segment->pos + sent);
         }
-        ret = 0;
-    } while (0);
+        if (sent < iov[i].iov_len)
+            break;
+    }
+    return ret > 0 ? ret : 0;
+}
+
+
+/* called from the source thread with each new block, which the chains are
+ * filled up with. They keep enough for a listener starting with a burst to
+ * be moved on to them */
+static void mp3_chains_add (source_t *source, refbuf_t *refbuf)
+{
+    mp3_state *source_mp3 = source->format->_state;
+    unsigned int i;
 
-    if (ret > 0)
-        written += ret;
-    return written;
+    source_mp3->stream_offset += refbuf->len;
+    for (i = 0; i < source_mp3->icy_chain_count; i++)
+    {
+        icychain_t *chain = &source_mp3->icy_chains[i];
+        unsigned int keep = source->burst_offset + chain->interval + ICY_METADATA_MAX;
+
+        icychain_append (chain, refbuf, 0);
+        icychain_trim (chain, keep, source->queue_size_limit + keep);
+    }
 }
 
+
+/* find the chain a listener at the start of an interval at the stream
+ * offset can follow. A new one starts from where the listener is in the
+ * source queue, taking over one nobody follows when all are in use */
+static icychain_t *mp3_chain_get (source_t *source, client_t *client, uint64_t offset)
+{
+    mp3_state *source_mp3 = source->format->_state;
+    mp3_client_data *client_mp3 = client->format_data;
+    icychain_t *chain = NULL;
+    refbuf_t *refbuf;
+    unsigned int i, pos;
+
+    if (client_mp3->interval > ICYCHAIN_INTERVAL_MAX)
+        return NULL;
+    for (i = 0; i < source_mp3->icy_chain_count; i++)
+        if (icychain_in_phase (&source_mp3->icy_chains[i], client_mp3->interval, offset))
+            return &source_mp3->icy_chains[i];
+
+    if (source_mp3->icy_chain_count < MP3_ICY_CHAINS)
+        chain = &source_mp3->icy_chains[source_mp3->icy_chain_count++];
+    for (i = 0; chain == NULL && i < MP3_ICY_CHAINS; i++)
+        if (icychain_unused (&source_mp3->icy_chains[i]))
+            chain = &source_mp3->icy_chains[i];
+    if (chain == NULL)
+        return NULL;
+    icychain_clear (chain);
+    icychain_init (chain, client_mp3->interval, offset);
+    chain->mount = source->mount;
+    for (refbuf = client->refbuf, pos = client->pos; refbuf; refbuf = refbuf->next, pos = 0)
+        icychain_append (chain, refbuf, pos);
+    ICECAST_LOG_DEBUG("metadata interval %u shared on %s", client_mp3->interval, source->mount);
+    return chain;
+}
+
+
+/* Listeners wanting metadata start on the source queue like any other, on
+ * a frame. When that is the start of an interval, which is when there was
+ * no intro, they are moved on to the chain whose blocks start where their
+ * intervals do, at once if a block starts where they are, else once they
+ * get to the first one.
+ */
+static void format_mp3_start_client (source_t *source, client_t *client)
+{
+    mp3_state *source_mp3 = source->format->_state;
+    mp3_client_data *client_mp3 = client->format_data;
+    icychain_t *chain;
+    refbuf_t *refbuf, *block;
+    uint64_t offset, start;
+
+    if (client_mp3 == NULL)
+        return;
+    client_mp3->chain = NULL;
+    refbuf_release (client_mp3->join);
+    client_mp3->join = NULL;
+    if (client_mp3->interval == 0 || client_mp3->since_meta_block || client_mp3->in_metadata)
+        return;
+
+    /* where the listener is in the stream, counted back from the end */
+    offset = source_mp3->stream_offset + client->pos;
+    for (refbuf = client->refbuf; refbuf; refbuf = refbuf->next)
+        offset -= refbuf->len;
+    client_mp3->offset = offset;
+
+    chain = mp3_chain_get (source, client, offset);
+    if (chain == NULL)
+        return;
+    block = icychain_block_at (chain, offset, &start);
+    if (block == NULL)
+        return;
+    client_mp3->chain = chain;
+    if (start == offset)
+    {
+        client_set_queue (client, block);
+        client->write_to_client = mp3_chain_write_to_client;
+        return;
+    }
+    refbuf_addref (block);
+    client_mp3->join = block;
+    client_mp3->join_offset = start;
+}
+
+
+/* The chain is sent as it is, like a stream without metadata. Where the
+ * listener is in the interval is kept up to date in case it is moved on
+ * to another stream, which it then carries on with.
+ */
+static int mp3_chain_write_to_client (client_t *client)
+{
+    mp3_client_data *client_mp3 = client->format_data;
+    icychain_t *chain = client_mp3->chain;
+    int ret;
+
+    if (chain == NULL || client->check_buffer != format_advance_queue)
+        return format_mp3_write_buf_to_client (client);
+
+    if (chain->lagging && client->refbuf == chain->head)
+    {
+        ICECAST_LOG_INFO("Client %lu (%s) has fallen too far behind, removing",
+                client->con->id, client->con->ip);
+        stats_event_inc (chain->mount, "slow_listeners");
+        client->con->error = 1;
+        return 0;
+    }
+    ret = format_generic_write_to_client (client);
+
+    client_mp3->associated = NULL;
+    client_mp3->metadata_offset = 0;
+    client_mp3->in_metadata = 0;
+    if (client->pos <= chain->interval)
+        client_mp3->since_meta_block = client->pos;
+    else if (client->pos == client->refbuf->len)
+        client_mp3->since_meta_block = 0;
+    else
+    {
+        client_mp3->since_meta_block = chain->interval;
+        client_mp3->metadata_offset = client->pos - chain->interval;
+        client_mp3->in_metadata = 1;
+    }
+    return ret;
+}
+
+
 static void format_mp3_free_plugin(format_plugin_t *self)
 {
     /* free the plugin instance */
     mp3_state *state = self->_state;
+    unsigned int i;
+
+    for (i = 0; i < state->icy_chain_count; i++)
+        icychain_clear (&state->icy_chains[i]);
 
     thread_mutex_destroy(&state->url_lock);
     free(self->charset);
@@ -460,7 +680,8 @@ static void format_mp3_free_plugin(format_plugin_t *self)
 /* This does the actual reading, making sure the read data is packaged in
  * blocks of 1400 bytes (near the common MTU size). This is because many
  * incoming streams come in small packets which could waste a lot of
- * bandwidth with many listeners due to headers and such like.
+ * bandwidth with many listeners due to headers and such like. A block
+ * can be larger when it has to hold a large MPEG frame.
  */
 static int complete_read(source_t *source)
 {
@@ -470,16 +691,16 @@ static int complete_read(source_t *source)
     char *buf;
     refbuf_t *refbuf;
 
-#define REFBUF_SIZE 1400
-
     if (source_mp3->read_data == NULL)
     {
         source_mp3->read_data = refbuf_new (REFBUF_SIZE);
         source_mp3->read_count = 0;
+        source_mp3->read_size = REFBUF_SIZE;
+        source_mp3->read_carry = 0;
     }
     buf = source_mp3->read_data->data + source_mp3->read_count;
 
-    bytes = client_read_bytes (source->client, buf, REFBUF_SIZE-source_mp3->read_count);
+    bytes = client_read_bytes (source->client, buf, source_mp3->read_size - source_mp3->read_count);
     if (bytes < 0)
     {
         if (source->client->con->error)
@@ -494,7 +715,7 @@ static int complete_read(source_t *source)
     refbuf->len = source_mp3->read_count;
     format->read_bytes += bytes;
 
-    if (source_mp3->read_count < REFBUF_SIZE)
+    if (source_mp3->read_count < (int)source_mp3->read_size)
     {
         if (source_mp3->read_count == 0)
         {
@@ -507,6 +728,98 @@ static int complete_read(source_t *source)
 }
 
 
+/* report the bitrate measured over the last period, and the samplerate
+ * and channels when they change. No channels is AAC with the layout given
+ * in the stream, which is not looked at */
+static void mp3_measure (source_t *source, const mpeg_block_t *block, unsigned int len)
+{
+    mp3_state *source_mp3 = source->format->_state;
+    unsigned int bitrate;
+
+    if (block->samplerate != source_mp3->samplerate || block->channels != source_mp3->channels)
+    {
+        source_mp3->samplerate = block->samplerate;
+        source_mp3->channels = block->channels;
+        source_mp3->measure_bytes = 0;
+        source_mp3->measure_samples = 0;
+        stats_event_args (source->mount, "audio_samplerate", "%u", block->samplerate);
+        if (block->channels)
+            stats_event_args (source->mount, "audio_channels", "%u", block->channels);
+    }
+    source_mp3->measure_bytes += len;
+    source_mp3->measure_samples += block->samples;
+    if (source_mp3->measure_samples < (uint64_t)block->samplerate * MP3_MEASURE_PERIOD)
+        return;
+
+    bitrate = (unsigned int)(source_mp3->measure_bytes * 8 * block->samplerate / source_mp3->measure_samples);
+    source_mp3->measure_bytes = 0;
+    source_mp3->measure_samples = 0;
+    /* rounded to kbit/s, so that it only changes with the stream */
+    bitrate = (bitrate + 500) / 1000 * 1000;
+    if (bitrate != source_mp3->bitrate)
+    {
+        source_mp3->bitrate = bitrate;
+        stats_event_args (source->mount, "audio_bitrate", "%u", bitrate);
+    }
+}
+
+
+/* Cut a block read from the source after the last complete frame, the
+ * rest is kept as the start of the next block. Blocks starting with a
+ * frame are marked as sync points and get their play time set. Returns
+ * NULL if nothing is left to queue.
+ */
+static refbuf_t *mp3_frame_align (source_t *source, refbuf_t *refbuf)
+{
+    mp3_state *source_mp3 = source->format->_state;
+    mpeg_block_t block;
+    unsigned int carry;
+    int disabled;
+
+    source_mp3->read_carry = 0;
+    if (source_mp3->frame_sync == 0)
+    {
+        refbuf->sync_point = 1;
+        return refbuf;
+    }
+
+    disabled = source_mp3->sync.disabled;
+    mpeg_sync_block (&source_mp3->sync, (unsigned char *)refbuf->data, refbuf->len, &block);
+    if (source_mp3->sync.disabled && disabled == 0)
+        ICECAST_LOG_WARN("No MPEG audio frames found on %s, passing the stream on as is", source->mount);
+
+    carry = refbuf->len - block.length;
+    if (carry)
+    {
+        unsigned int size = REFBUF_SIZE;
+
+        if (block.partial > size)
+            size = block.partial;
+        if (size <= carry)
+            size = carry + REFBUF_SIZE;
+        source_mp3->read_data = refbuf_new (size);
+        memcpy (source_mp3->read_data->data, refbuf->data + block.length, carry);
+        source_mp3->read_count = carry;
+        source_mp3->read_size = size;
+        source_mp3->read_carry = carry;
+        refbuf->len = block.length;
+    }
+    if (refbuf->len == 0)
+    {
+        refbuf_release (refbuf);
+        return NULL;
+    }
+
+    refbuf->sync_point = block.sync_point;
+    if (block.samples)
+    {
+        refbuf->duration = (unsigned int)((uint64_t)block.samples * 1000000 / block.samplerate);
+        mp3_measure (source, &block, refbuf->len);
+    }
+    return refbuf;
+}
+
+
 /* read an mp3 stream which does not have shoutcast style metadata */
 static refbuf_t *mp3_get_no_meta (source_t *source)
 {
@@ -524,9 +837,12 @@ static refbuf_t *mp3_get_no_meta (source_t *source)
         mp3_set_title (source);
         source_mp3->update_metadata = 0;
     }
+    refbuf = mp3_frame_align (source, refbuf);
+    if (refbuf == NULL)
+        return NULL;
     refbuf->associated = source_mp3->metadata;
     refbuf_addref (source_mp3->metadata);
-    refbuf->sync_point = 1;
+    mp3_chains_add (source, refbuf);
     return refbuf;
 }
 
@@ -555,9 +871,11 @@ static refbuf_t *mp3_get_filter_meta(source_t *source)
         mp3_set_title (source);
         source_mp3->update_metadata = 0;
     }
-    /* fill the buffer with the read data */
-    bytes = source_mp3->read_count;
-    refbuf->len = 0;
+    /* fill the buffer with the read data, after what is left over from
+     * the block before which has been filtered already */
+    src += source_mp3->read_carry;
+    bytes = source_mp3->read_count - source_mp3->read_carry;
+    refbuf->len = source_mp3->read_carry;
     while (bytes > 0)
     {
         unsigned int metadata_remaining;
@@ -645,9 +963,12 @@ static refbuf_t *mp3_get_filter_meta(source_t *source)
         refbuf_release (refbuf);
         return NULL;
     }
+    refbuf = mp3_frame_align (source, refbuf);
+    if (refbuf == NULL)
+        return NULL;
     refbuf->associated = source_mp3->metadata;
     refbuf_addref (source_mp3->metadata);
-    refbuf->sync_point = 1;
+    mp3_chains_add (source, refbuf);
 
     return refbuf;
 }
@@ -710,6 +1031,9 @@ static int format_mp3_create_client_data(source_t *source, client_t *client)
 
 static void free_mp3_client_data (client_t *client)
 {
+    mp3_client_data *client_mp3 = client->format_data;
+
+    refbuf_release (client_mp3->join);
     free (client->format_data);
     client->format_data = NULL;
 }
@@ -18,10 +18,17 @@
 #ifndef __FORMAT_MP3_H__
 #define __FORMAT_MP3_H__
 
+#include "mpeg.h"
+#include "icychain.h"
+
 #define MP3_METADATA_TITLE  "X_ICY_TITLE"
 #define MP3_METADATA_ARTIST "X_ICY_ARTIST"
 #define MP3_METADATA_URL    "X_ICY_URL"
 
+/* how many chains are kept, for different metadata intervals or for
+ * listeners whose intervals start elsewhere in the stream */
+#define MP3_ICY_CHAINS      4
+
 typedef struct {
     /* These are for inline metadata */
     int inline_metadata_interval;
@@ -33,13 +40,31 @@ typedef struct {
     refbuf_t *metadata;
     refbuf_t *read_data;
     int read_count;
+    unsigned int read_size;     /* what read_data is filled up to */
+    unsigned int read_carry;    /* stream data at the start of read_data
+                                   taken over from the block before */
     mutex_t url_lock;
 
+    /* MPEG audio is cut into blocks of whole frames */
+    int frame_sync;
+    mpeg_sync_t sync;
+    uint64_t measure_bytes;
+    uint64_t measure_samples;
+    unsigned int samplerate;
+    unsigned int channels;
+    unsigned int bitrate;
+
+    icychain_t icy_chains[MP3_ICY_CHAINS];
+    unsigned int icy_chain_count;
+    uint64_t stream_offset;     /* mp3 queued so far */
+
     unsigned build_metadata_len;
     unsigned build_metadata_offset;
     char build_metadata[4081];
 } mp3_state;
 
 int format_mp3_get_plugin(struct source_tag *src);
+/* AAC in ADTS frames, handled like mp3 apart from the framing */
+int format_aac_get_plugin(struct source_tag *src);
 
 #endif  /* __FORMAT_MP3_H__ */
@@ -46,6 +46,7 @@
 #include "format_flac.h"
 #include "format_kate.h"
 #include "format_skeleton.h"
+#include "oggpage.h"
 
 #ifdef _WIN32
 #define snprintf _snprintf
@@ -53,10 +54,19 @@
 
 #define CATMODULE "format-ogg"
 #include "logging.h"
+#include "common/timing/timing.h"
+
+/* size of the blocks read from the source, pages are sliced out of them */
+#define OGG_READ_SIZE 8192
+
+/* pages are queued in blocks that fit a packet, held no longer than this */
+#define OGG_AGGREGATE_SIZE      1400
+#define OGG_AGGREGATE_LATENCY   100
 
 struct _ogg_state_tag;
 
 static void format_ogg_free_plugin(format_plugin_t *plugin);
+static void format_ogg_apply_settings(client_t *client, format_plugin_t *format, mount_proxy *mount);
 static int create_ogg_client_data(source_t *source, client_t *client);
 static void free_ogg_client_data(client_t *client);
 
@@ -74,9 +84,23 @@ struct ogg_client
 };
 
 
-refbuf_t *make_refbuf_with_page (ogg_page *page)
+/* the page read from the source is handed out as it is, other pages made
+ * up by the codecs are copied */
+refbuf_t *make_refbuf_with_page (ogg_state_t *ogg_info, ogg_page *page)
 {
-    refbuf_t *refbuf = refbuf_new (page->header_len + page->body_len);
+    refbuf_t *refbuf;
+
+    if (ogg_info->page && page->header == (unsigned char *)ogg_info->page->data &&
+            page->body == page->header + page->header_len &&
+            page->header_len + page->body_len == ogg_info->page->len)
+    {
+        /* sliced from the read block itself, so pages next to each other
+         * can be joined */
+        refbuf_t *block = ogg_info->page->_parent;
+
+        return refbuf_new_slice (block, ogg_info->page->data - block->data, ogg_info->page->len);
+    }
+    refbuf = refbuf_new (page->header_len + page->body_len);
 
     memcpy (refbuf->data, page->header, page->header_len);
     memcpy (refbuf->data+page->header_len, page->body, page->body_len);
@@ -89,7 +113,7 @@ refbuf_t *make_refbuf_with_page (ogg_page *page)
  */
 void format_ogg_attach_header (ogg_state_t *ogg_info, ogg_page *page)
 {
-    refbuf_t *refbuf = make_refbuf_with_page (page);
+    refbuf_t *refbuf = make_refbuf_with_page (ogg_info, page);
 
     if (ogg_page_bos (page))
     {
@@ -171,23 +195,43 @@ int format_ogg_get_plugin(source_t *source)
     plugin->write_buf_to_file = write_ogg_to_file;
     plugin->create_client_data = create_ogg_client_data;
     plugin->free_plugin = format_ogg_free_plugin;
+    plugin->apply_settings = format_ogg_apply_settings;
     plugin->set_tag = NULL;
     if (strcmp (httpp_getvar (source->parser, "content-type"), "application/x-ogg") == 0)
         httpp_setvar (source->parser, "content-type", "application/ogg");
     plugin->contenttype = httpp_getvar (source->parser, "content-type");
 
-    ogg_sync_init (&state->oy);
     vorbis_comment_init(&plugin->vc);
 
     plugin->_state = state;
     source->format = plugin;
     state->mount = source->mount;
     state->bos_end = &state->header_pages;
+    state->aggregate_size = OGG_AGGREGATE_SIZE;
+    state->aggregate_latency = OGG_AGGREGATE_LATENCY;
 
     return 0;
 }
 
 
+static void format_ogg_apply_settings (client_t *client, format_plugin_t *format, mount_proxy *mount)
+{
+    ogg_state_t *ogg_info = format->_state;
+
+    ogg_info->aggregate_size = OGG_AGGREGATE_SIZE;
+    ogg_info->aggregate_latency = OGG_AGGREGATE_LATENCY;
+    if (mount)
+    {
+        if (mount->ogg_aggregate_size >= 0)
+            ogg_info->aggregate_size = mount->ogg_aggregate_size;
+        if (mount->ogg_aggregate_latency)
+            ogg_info->aggregate_latency = mount->ogg_aggregate_latency;
+    }
+    ICECAST_LOG_DEBUG("queueing pages in blocks of up to %u bytes, held up to %ums",
+            ogg_info->aggregate_size, ogg_info->aggregate_latency);
+}
+
+
 static void format_ogg_free_plugin (format_plugin_t *plugin)
 {
     ogg_state_t *state = plugin->_state;
@@ -195,7 +239,9 @@ static void format_ogg_free_plugin (format_plugin_t *plugin)
     /* free memory associated with this plugin instance */
     free_ogg_codecs (state);
 
-    ogg_sync_clear (&state->oy);
+    refbuf_release (state->aggregate);
+    refbuf_release (state->page);
+    refbuf_release (state->read_data);
 
     free (state);
 
@@ -369,6 +415,68 @@ static refbuf_t *complete_buffer (source_t *source, refbuf_t *refbuf)
 }
 
 
+/* hand back the block being filled if it is full or has been held long
+ * enough, or whatever is held when forced to, else NULL
+ */
+static refbuf_t *ogg_aggregate_flush (ogg_state_t *ogg_info, int force)
+{
+    refbuf_t *aggregate = ogg_info->aggregate;
+
+    if (aggregate == NULL)
+        return NULL;
+    if (force || aggregate->len + OGGPAGE_HEADER_MIN >= ogg_info->aggregate_size ||
+            timing_get_time() - ogg_info->aggregate_start >= ogg_info->aggregate_latency)
+    {
+        ogg_info->aggregate = NULL;
+        return aggregate;
+    }
+    return NULL;
+}
+
+
+/* put a completed page in the block being filled for the queue. A block
+ * only holds pages with the same set of headers, and a page that is a
+ * starting point the codecs marked begins a new one, so listeners still
+ * start on it. Returns a block when one is ready, else NULL.
+ */
+static refbuf_t *ogg_aggregate (ogg_state_t *ogg_info, refbuf_t *refbuf)
+{
+    refbuf_t *aggregate = ogg_info->aggregate;
+
+    if (ogg_info->aggregate_size == 0)
+        return refbuf;
+    if (aggregate && aggregate->associated == refbuf->associated &&
+            aggregate->len + refbuf->len <= ogg_info->aggregate_size &&
+            (ogg_info->codec_sync == NULL || refbuf->sync_point == 0))
+    {
+        /* pages next to each other in the read block need no copy */
+        int joined = refbuf_join_slice (aggregate, refbuf) == 0;
+
+        if (!joined && refbuf_resize (aggregate, aggregate->len + refbuf->len) == 0)
+        {
+            memcpy (aggregate->data + aggregate->len - refbuf->len, refbuf->data, refbuf->len);
+            joined = 1;
+        }
+        if (joined)
+        {
+            if (aggregate->duration && refbuf->duration)
+                aggregate->duration += refbuf->duration;
+            else
+                aggregate->duration = 0;
+            refbuf_release (refbuf);
+            return ogg_aggregate_flush (ogg_info, 0);
+        }
+    }
+    /* the page starts the next block, one already full is queued on the
+     * next call */
+    ogg_info->aggregate = refbuf;
+    ogg_info->aggregate_start = timing_get_time();
+    if (aggregate)
+        return aggregate;
+    return ogg_aggregate_flush (ogg_info, 0);
+}
+
+
 /* process the incoming page. this requires searching through the
  * currently known codecs that have been seen in the stream
  */
@@ -393,6 +501,78 @@ static refbuf_t *process_ogg_page(ogg_state_t *ogg_info, ogg_page *page, format_
 }
 
 
+/* find the next page in what has been read, returns 1 if there is one */
+static int ogg_next_page (ogg_state_t *ogg_info, ogg_page *page)
+{
+    while (ogg_info->read_pos < ogg_info->read_count)
+    {
+        unsigned char *data = (unsigned char *)ogg_info->read_data->data + ogg_info->read_pos;
+        unsigned int length;
+        int ret = oggpage_check (data, ogg_info->read_count - ogg_info->read_pos, &length);
+
+        if (ret < 0)
+        {
+            ogg_info->read_pos += length;
+            continue;
+        }
+        if (ret == 0)
+        {
+            ogg_info->read_need = length;
+            return 0;
+        }
+        refbuf_release (ogg_info->page);
+        ogg_info->page = refbuf_new_slice (ogg_info->read_data, ogg_info->read_pos, length);
+        ogg_info->read_pos += length;
+        ogg_info->read_need = 0;
+
+        page->header = data;
+        page->header_len = OGGPAGE_HEADER_MIN + data[26];
+        page->body = data + page->header_len;
+        page->body_len = length - page->header_len;
+        return 1;
+    }
+    return 0;
+}
+
+
+/* read more of the stream, after what is still to be paged. A new block
+ * is started, with that part moved over, when it will not fit in what
+ * is left of the current one. Returns 0 if nothing was read.
+ */
+static int ogg_read (source_t *source)
+{
+    ogg_state_t *ogg_info = source->format->_state;
+    unsigned int left = ogg_info->read_count - ogg_info->read_pos;
+    unsigned int need = ogg_info->read_need ? ogg_info->read_need : OGGPAGE_HEADER_MIN + 255;
+    int bytes;
+
+    if (ogg_info->read_data == NULL || ogg_info->read_pos + need > ogg_info->read_size ||
+            ogg_info->read_count == ogg_info->read_size)
+    {
+        unsigned int size = OGG_READ_SIZE;
+        refbuf_t *refbuf;
+
+        if (need > size)
+            size = need;
+        refbuf = refbuf_new (size);
+        if (left)
+            memcpy (refbuf->data, ogg_info->read_data->data + ogg_info->read_pos, left);
+        refbuf_release (ogg_info->read_data);
+        ogg_info->read_data = refbuf;
+        ogg_info->read_size = size;
+        ogg_info->read_count = left;
+        ogg_info->read_pos = 0;
+    }
+    bytes = client_read_bytes (source->client, ogg_info->read_data->data + ogg_info->read_count,
+            ogg_info->read_size - ogg_info->read_count);
+    if (bytes <= 0)
+        return 0;
+    source->format->read_bytes += bytes;
+    ogg_info->read_count += bytes;
+    return 1;
+}
+
+
 /* main plugin handler for getting a buffer for the queue. In here we
  * just add an incoming page to the codecs and process it until either
  * more data is needed or we prodice a buffer for the queue.
@@ -400,10 +580,10 @@ static refbuf_t *process_ogg_page(ogg_state_t *ogg_info, ogg_page *page, format_
 static refbuf_t *ogg_get_buffer(source_t *source)
 {
     ogg_state_t *ogg_info = source->format->_state;
-    format_plugin_t *format = source->format;
-    char *data = NULL;
-    int bytes = 0;
+    refbuf_t *aggregate = ogg_aggregate_flush (ogg_info, 0);
 
+    if (aggregate)
+        return aggregate;
     while (1)
     {
         while (1)
@@ -417,12 +597,17 @@ static refbuf_t *ogg_get_buffer(source_t *source)
             {
                 refbuf = codec->process (ogg_info, codec, source->format);
                 if (refbuf)
-                    return complete_buffer (source, refbuf);
+                {
+                    aggregate = ogg_aggregate (ogg_info, complete_buffer (source, refbuf));
+                    if (aggregate)
+                        return aggregate;
+                    continue;
+                }
 
                 ogg_info->current = NULL;
             }
 
-            if (ogg_sync_pageout (&ogg_info->oy, &page) > 0)
+            if (ogg_next_page (ogg_info, &page) > 0)
             {
                 if (ogg_page_bos (&page))
                 {
@@ -440,23 +625,19 @@ static refbuf_t *ogg_get_buffer(source_t *source)
                     return NULL;
                 }
                 if (refbuf)
-                    return complete_buffer (source, refbuf);
+                {
+                    aggregate = ogg_aggregate (ogg_info, complete_buffer (source, refbuf));
+                    if (aggregate)
+                        return aggregate;
+                }
                 continue;
             }
             /* need more stream data */
             break;
         }
         /* we need more data to continue getting pages */
-        data = ogg_sync_buffer (&ogg_info->oy, 4096);
-
-        bytes = client_read_bytes (source->client, data, 4096);
-        if (bytes <= 0)
-        {
-            ogg_sync_wrote (&ogg_info->oy, 0);
-            return NULL;
-        }
-        format->read_bytes += bytes;
-        ogg_sync_wrote (&ogg_info->oy, bytes);
+        if (ogg_read (source) == 0)
+            return ogg_aggregate_flush (ogg_info, source->client->con->error);
     }
 }
 
@@ -484,82 +665,126 @@ static void free_ogg_client_data (client_t *client)
 }
 
 
-/* send out the header pages. These are for all codecs but are
- * in the order for the stream, ie BOS pages first
- */
-static int send_ogg_headers (client_t *client, refbuf_t *headers)
-{
-    struct ogg_client *client_data = client->format_data;
-    refbuf_t *refbuf;
-    int written = 0;
-
-    if (client_data->headers_sent)
-    {
-        client_data->header_page = headers;
-        client_data->pos = 0;
-        client_data->headers_sent = 0;
-    }
-    refbuf = client_data->header_page;
-    while (refbuf)
-    {
-        char *data = refbuf->data + client_data->pos;
-        unsigned len = refbuf->len - client_data->pos;
-        int ret;
-
-        ret = client_send_bytes(client, data, len);
-        if (ret > 0)
-            written += ret;
-        if (ret < (int) len)
-            return written ? written : -1;
-        client_data->pos += ret;
-        if (client_data->pos == refbuf->len)
-        {
-            refbuf = refbuf->next;
-            client_data->header_page = refbuf;
-            client_data->pos = 0;
-        }
-    }
-    client_data->headers_sent = 1;
-    client_data->headers = headers;
-    return written;
-}
+/* a piece of what is handed to the socket in one go, either a page from
+ * the queue, a header page or a mark where a set of headers is complete */
+typedef struct {
+    refbuf_t *refbuf;       /* the page, or the headers marked as sent */
+    unsigned int pos;       /* where in the page this piece starts */
+    enum { OGG_SEGMENT_PAGE, OGG_SEGMENT_HEADER, OGG_SEGMENT_HEADERS_SENT } type;
+} ogg_segment;
 
 
-/* main client write routine for sending ogg data. Each refbuf has a
- * single page so we only need to determine if there are new headers
+/* main client write routine for sending ogg data. Each refbuf has whole
+ * pages so we only need to determine if there are new headers.
+ * The header pages are for all codecs but are in the order for the
+ * stream, ie BOS pages first. As much of the queue as possible is
+ * gathered, with the header pages in front of the pages they belong to,
+ * and the client state is then moved on by whatever the socket took.
  */
 static int write_buf_to_client(client_t *client)
 {
-    refbuf_t *refbuf = client->refbuf;
-    char *buf = refbuf->data + client->pos;
-    unsigned len = refbuf->len - client->pos;
     struct ogg_client *client_data = client->format_data;
-    int ret, written = 0;
+    struct iovec iov[FORMAT_MAX_IOV];
+    ogg_segment segments[FORMAT_MAX_IOV];
+    refbuf_t *refbuf = client->refbuf;
+    refbuf_t *headers = client_data->headers;
+    unsigned int pos = client->pos;
+    unsigned int count = 0, total = 0, left, i;
+    int headers_sent = client_data->headers_sent;
+    int ret;
 
-    do
+    while (count < FORMAT_MAX_IOV && total < FORMAT_GATHER_LIMIT)
     {
-        if (client_data->headers != refbuf->associated)
+        if (headers != refbuf->associated)
         {
-            ret = send_ogg_headers (client, refbuf->associated);
-            if (client_data->headers_sent == 0)
+            refbuf_t *page = client_data->header_page;
+            unsigned int page_pos = client_data->pos;
+
+            if (headers_sent)
+            {
+                /* start on the new set of headers */
+                page = refbuf->associated;
+                page_pos = 0;
+            }
+            for (; page && count < FORMAT_MAX_IOV; page = page->next, page_pos = 0)
+            {
+                iov[count].iov_base = page->data + page_pos;
+                iov[count].iov_len = page->len - page_pos;
+                segments[count].refbuf = page;
+                segments[count].pos = page_pos;
+                segments[count].type = OGG_SEGMENT_HEADER;
+                total += page->len - page_pos;
+                count++;
+            }
+            if (count == FORMAT_MAX_IOV)
                 break;
-            written += ret;
+            iov[count].iov_base = NULL;
+            iov[count].iov_len = 0;
+            segments[count].refbuf = refbuf->associated;
+            segments[count].type = OGG_SEGMENT_HEADERS_SENT;
+            count++;
+            headers = refbuf->associated;
+            headers_sent = 1;
+            continue;
         }
-        ret = client_send_bytes (client, buf, len);
-
-        if (ret > 0)
-            client->pos += ret;
-
-        if (ret < (int)len)
+        if (pos < refbuf->len)
+        {
+            iov[count].iov_base = refbuf->data + pos;
+            iov[count].iov_len = refbuf->len - pos;
+            segments[count].refbuf = refbuf;
+            segments[count].pos = pos;
+            segments[count].type = OGG_SEGMENT_PAGE;
+            total += refbuf->len - pos;
+            count++;
+        }
+        if (refbuf->next == NULL || format_client_can_gather (client) == 0)
             break;
-        written += ret;
-        /* we have now written the page(s) */
+        refbuf = refbuf->next;
+        pos = 0;
+    }
+
+    if (total == 0)
         ret = 0;
-    } while (0);
+    else if (count == 1)
+        ret = client_send_bytes (client, iov[0].iov_base, iov[0].iov_len);
+    else
+        ret = client_send_iovec (client, iov, count);
+
+    /* now move the client on by what was actually written */
+    left = ret > 0 ? ret : 0;
+    for (i = 0; i < count; i++)
+    {
+        ogg_segment *segment = &segments[i];
+        unsigned int sent = left < iov[i].iov_len ? left : iov[i].iov_len;
 
-    if (ret > 0)
-       written += ret;
-    return written;
+        left -= sent;
+        switch (segment->type)
+        {
+            case OGG_SEGMENT_HEADER:
+                client_data->headers_sent = 0;
+                if (sent < iov[i].iov_len)
+                {
+                    client_data->header_page = segment->refbuf;
+                    client_data->pos = segment->pos + sent;
+                    break;
+                }
+                client_data->header_page = segment->refbuf->next;
+                client_data->pos = 0;
+                continue;
+            case OGG_SEGMENT_HEADERS_SENT:
+                client_data->headers_sent = 1;
+                client_data->headers = segment->refbuf;
+                continue;
+            case OGG_SEGMENT_PAGE:
+                if (sent)
+                    format_client_seek (client, segment->refbuf, segment->pos + sent);
+                if (sent < iov[i].iov_len)
+                    break;
+                continue;
+        }
+        break;
+    }
+    return ret > 0 ? ret : 0;
 }
 
 
@@ -25,9 +25,22 @@
 typedef struct ogg_state_tag
 {
     char *mount;
-    ogg_sync_state oy;
     int error;
 
+    /* pages are sliced out of the read buffer as they are found */
+    refbuf_t *read_data;
+    unsigned int read_size;
+    unsigned int read_count;
+    unsigned int read_pos;      /* where the next page starts */
+    unsigned int read_need;     /* length of a page not all read yet */
+    refbuf_t *page;             /* the page being processed */
+
+    /* pages for the queue are put together in blocks of up to this size */
+    unsigned int aggregate_size;
+    unsigned int aggregate_latency; /* longest a block is held, in ms */
+    refbuf_t *aggregate;            /* the block being filled */
+    uint64_t aggregate_start;
+
     int codec_count;
     struct ogg_codec_tag *codecs;
     int log_metadata;
@@ -60,7 +73,7 @@ typedef struct ogg_codec_tag
 } ogg_codec_t;
 
 
-refbuf_t *make_refbuf_with_page (ogg_page *page);
+refbuf_t *make_refbuf_with_page (ogg_state_t *ogg_info, ogg_page *page);
 void format_ogg_attach_header (ogg_state_t *ogg_info, ogg_page *page);
 void format_ogg_free_headers (ogg_state_t *ogg_info);
 int format_ogg_get_plugin (source_t *source);
@@ -156,7 +156,7 @@ static refbuf_t *get_buffer_audio (ogg_state_t *ogg_info, ogg_codec_t *codec)
         source_vorbis->samples_in_page -= (ogg_page_granulepos (&page) - source_vorbis->prev_page_samples);
         source_vorbis->prev_page_samples = ogg_page_granulepos (&page);
 
-        refbuf = make_refbuf_with_page (&page);
+        refbuf = make_refbuf_with_page (ogg_info, &page);
     }
     return refbuf;
 }
@@ -192,7 +192,7 @@ static refbuf_t *get_buffer_finished(ogg_state_t *ogg_info, ogg_codec_t *codec)
         source_vorbis->samples_in_page -= (ogg_page_granulepos (&page) - source_vorbis->prev_page_samples);
         source_vorbis->prev_page_samples = ogg_page_granulepos (&page);
 
-        refbuf = make_refbuf_with_page (&page);
+        refbuf = make_refbuf_with_page (ogg_info, &page);
         ICECAST_LOG_DEBUG("flushing page");
         return refbuf;
     }
@@ -472,7 +472,7 @@ static refbuf_t *process_vorbis (ogg_state_t *ogg_info, ogg_codec_t *codec, form
 static refbuf_t *process_vorbis_passthru_page (ogg_state_t *ogg_info,
         ogg_codec_t *codec, ogg_page *page, format_plugin_t *plugin)
 {
-    return make_refbuf_with_page (page);
+    return make_refbuf_with_page (ogg_info, page);
 }
 
 
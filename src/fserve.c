@@ -22,8 +22,9 @@
 #include <sys/stat.h>
 #include <errno.h>
 
-#ifdef HAVE_POLL
-#include <sys/poll.h>
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#define FSERVE_SENDFILE
 #endif
 
 #ifndef _WIN32
@@ -59,6 +60,7 @@
 #include "util.h"
 #include "admin.h"
 #include "compat.h"
+#include "pollset.h"
 
 #include "fserve.h"
 
@@ -67,24 +69,29 @@
 
 #define BUFSIZE 4096
 
+/* most handed to sendfile() for one client in one go */
+#define SENDFILE_CHUNK 65536
+
+/* most events taken from the pollset in one go */
+#define FSERVE_EVENTS 64
+
 static volatile int __inited = 0;
 
-static fserve_t *active_list = NULL;
-static fserve_t *pending_list = NULL;
+typedef struct fserve_worker_tag {
+    pollset_t *pollset;
+    fserve_t *pending;      /* handed over, not yet picked up by the thread */
+    fserve_t *active;
+    int running;            /* thread started and not yet finished */
+} fserve_worker_t;
 
-static spin_t pending_lock;
+static fserve_worker_t *workers;
+static unsigned int worker_count;
+static unsigned int next_worker;
+
+static spin_t pending_lock; /* for the worker lists and run state */
 static avl_tree *mimetypes = NULL;
 
 static volatile int run_fserv = 0;
-static unsigned int fserve_clients;
-static int client_tree_changed = 0;
-
-#ifdef HAVE_POLL
-static struct pollfd *ufds = NULL;
-#else
-static fd_set fds;
-static sock_t fd_max = SOCK_ERROR;
-#endif
 
 typedef struct {
     char *ext;
@@ -98,12 +105,24 @@ static void *fserv_thread_function(void *arg);
 void fserve_initialize(void)
 {
     ice_config_t *config = config_get_config();
+    unsigned int i;
 
     mimetypes = NULL;
-    active_list = NULL;
-    pending_list = NULL;
     thread_spin_create (&pending_lock);
 
+    worker_count = config->fileserve_threads ? config->fileserve_threads : 1;
+    workers = calloc (worker_count, sizeof (fserve_worker_t));
+    if (workers == NULL)
+        worker_count = 0;
+    for (i = 0; i < worker_count; i++)
+    {
+        workers[i].pollset = pollset_new ();
+        if (workers[i].pollset)
+            pollset_wakeup_enable (workers[i].pollset);
+    }
+    next_worker = 0;
+    run_fserv = 1;
+
     fserve_recheck_mime_types (config);
     config_release_config();
 
@@ -115,230 +134,234 @@ void fserve_initialize(void)
 
 void fserve_shutdown(void)
 {
+    unsigned int i;
+
     if (!__inited)
         return;
 
     thread_spin_lock (&pending_lock);
     run_fserv = 0;
-    while (pending_list)
+    for (i = 0; i < worker_count; i++)
+        pollset_wakeup (workers[i].pollset);
+    thread_spin_unlock (&pending_lock);
+
+    /* the worker threads are detached, wait for them to leave */
+    while (1)
     {
-        fserve_t *to_go = (fserve_t *)pending_list;
-        pending_list = to_go->next;
+        unsigned int running = 0;
 
-        fserve_client_destroy (to_go);
+        thread_spin_lock (&pending_lock);
+        for (i = 0; i < worker_count; i++)
+            running += workers[i].running;
+        thread_spin_unlock (&pending_lock);
+        if (running == 0)
+            break;
+        thread_sleep (10000);
     }
-    while (active_list)
+
+    for (i = 0; i < worker_count; i++)
     {
-        fserve_t *to_go = active_list;
-        active_list = to_go->next;
-        fserve_client_destroy (to_go);
+        fserve_worker_t *worker = &workers[i];
+
+        while (worker->pending)
+        {
+            fserve_t *to_go = worker->pending;
+            worker->pending = to_go->next;
+            fserve_client_destroy (to_go);
+        }
+        while (worker->active)
+        {
+            fserve_t *to_go = worker->active;
+            worker->active = to_go->next;
+            fserve_client_destroy (to_go);
+        }
+        pollset_free (worker->pollset);
     }
+    free (workers);
+    workers = NULL;
+    worker_count = 0;
 
+    thread_spin_lock (&pending_lock);
     if (mimetypes)
         avl_tree_free (mimetypes, _delete_mapping);
-
+    mimetypes = NULL;
     thread_spin_unlock (&pending_lock);
     thread_spin_destroy (&pending_lock);
     ICECAST_LOG_INFO("file serving stopped");
 }
 
-#ifdef HAVE_POLL
-int fserve_client_waiting (void)
+/* Each worker thread looks after its own set of clients, started when
+ * the first client is handed to it and leaving once it has none left.
+ * The sockets stay registered in the pollset of the worker, so adding or
+ * removing a client does not involve the others and only the clients
+ * reported as writable are looked at.
+ */
+static void fserve_worker_add (fserve_worker_t *worker, fserve_t *fclient)
 {
-    fserve_t *fclient;
-    unsigned int i = 0;
-
-    /* only rebuild ufds if there are clients added/removed */
-    if (client_tree_changed) {
-        struct pollfd *ufds_new = realloc(ufds, fserve_clients * sizeof(struct pollfd));
-        /* REVIEW: If we can not allocate new ufds, keep old ones for now. */
-        if (ufds_new || fserve_clients == 0) {
-            ufds = ufds_new;
-            client_tree_changed = 0;
-            fclient = active_list;
-            while (fclient)
-            {
-                ufds[i].fd = fclient->client->con->sock;
-                ufds[i].events = POLLOUT;
-                ufds[i].revents = 0;
-                fclient = fclient->next;
-                i++;
-            }
-        }
-    }
+    while (fclient)
+    {
+        fserve_t *to_move = fclient;
 
-    if (!ufds) {
-        thread_spin_lock (&pending_lock);
-        run_fserv = 0;
-        thread_spin_unlock (&pending_lock);
-        return -1;
-    } else if (poll(ufds, fserve_clients, 200) > 0) {
-        /* mark any clients that are ready */
-        fclient = active_list;
-        for (i=0; i<fserve_clients; i++)
+        fclient = fclient->next;
+        if (worker->pollset &&
+                pollset_add (worker->pollset, to_move->client->con->sock, POLLSET_WRITE, to_move) < 0)
         {
-            if (ufds[i].revents & (POLLOUT|POLLHUP|POLLERR))
-            fclient->ready = 1;
-            fclient = fclient->next;
+            ICECAST_LOG_WARN("unable to watch socket of client %lu", to_move->client->con->id);
+            fserve_client_destroy (to_move);
+            continue;
         }
-        return 1;
+        to_move->prev = NULL;
+        to_move->next = worker->active;
+        if (worker->active)
+            worker->active->prev = to_move;
+        worker->active = to_move;
     }
-
-    return 0;
 }
-#else
-int fserve_client_waiting(void)
+
+static void fserve_worker_remove (fserve_worker_t *worker, fserve_t *fclient)
 {
-    fserve_t *fclient;
-    fd_set realfds;
-
-    /* only rebuild fds if there are clients added/removed */
-    if (client_tree_changed) {
-        client_tree_changed = 0;
-        FD_ZERO(&fds);
-        fd_max = SOCK_ERROR;
-        fclient = active_list;
-        while (fclient) {
-            FD_SET(fclient->client->con->sock, &fds);
-            if (fclient->client->con->sock > fd_max || fd_max == SOCK_ERROR)
-                fd_max = fclient->client->con->sock;
-            fclient = fclient->next;
-        }
-    }
-    /* hack for windows, select needs at least 1 descriptor */
-    if (fd_max == SOCK_ERROR)
-    {
-        thread_spin_lock (&pending_lock);
-        run_fserv = 0;
-        thread_spin_unlock (&pending_lock);
-        return -1;
-    }
+    if (worker->pollset)
+        pollset_remove (worker->pollset, fclient->client->con->sock);
+    if (fclient->prev)
+        fclient->prev->next = fclient->next;
     else
+        worker->active = fclient->next;
+    if (fclient->next)
+        fclient->next->prev = fclient->prev;
+    fserve_client_destroy (fclient);
+}
+
+#ifdef FSERVE_SENDFILE
+/* send the next part of the file without it passing through a buffer.
+ * returns the number of bytes sent, 0 at the end of the file or -1 if
+ * nothing could be sent
+ */
+static int fserve_sendfile (fserve_t *fclient)
+{
+    connection_t *con = fclient->client->con;
+    ssize_t ret;
+
+    ret = sendfile (con->sock, fileno (fclient->file), &fclient->offset, SENDFILE_CHUNK);
+    if (ret < 0)
     {
-        struct timeval tv;
-        tv.tv_sec = 0;
-        tv.tv_usec = 200000;
-        /* make a duplicate of the set so we do not have to rebuild it
-         * each time around */
-        memcpy(&realfds, &fds, sizeof(fd_set));
-        if(select(fd_max+1, NULL, &realfds, NULL, &tv) > 0)
+        if (errno == EINVAL || errno == ENOSYS)
         {
-            /* mark any clients that are ready */
-            fclient = active_list;
-            while (fclient)
-            {
-                if (FD_ISSET (fclient->client->con->sock, &realfds))
-                    fclient->ready = 1;
-                fclient = fclient->next;
-            }
-            return 1;
+            /* not for this file, so read it in from where we got to */
+            ICECAST_LOG_DEBUG("sendfile not usable for client %lu, reading file instead", con->id);
+            fclient->sendfile = 0;
+            if (fseeko (fclient->file, fclient->offset, SEEK_SET) != 0)
+                con->error = 1;
         }
+        else if (!sock_recoverable (errno))
+            con->error = 1;
+        return -1;
     }
-    return 0;
+    con->sent_bytes += ret;
+    return (int)ret;
 }
 #endif
 
-static int wait_for_fds(void)
+/* send the next part to a client whose socket is writable, returns -1
+ * once the client is finished with */
+static int fserve_client_send (fserve_t *fclient)
 {
-    fserve_t *fclient;
-    int ret;
+    client_t *client = fclient->client;
+    refbuf_t *refbuf = client->refbuf;
+    size_t bytes;
 
-    while (run_fserv)
+#ifdef FSERVE_SENDFILE
+    if (client->pos == refbuf->len && fclient->sendfile)
     {
-        /* add any new clients here */
-        if (pending_list)
+        if (fserve_sendfile (fclient) == 0)
         {
-            thread_spin_lock (&pending_lock);
-
-            fclient = (fserve_t*)pending_list;
-            while (fclient)
-            {
-                fserve_t *to_move = fclient;
-                fclient = fclient->next;
-                to_move->next = active_list;
-                active_list = to_move;
-                client_tree_changed = 1;
-                fserve_clients++;
-            }
-            pending_list = NULL;
-            thread_spin_unlock(&pending_lock);
+            /* end of file, finish off as if there was no file */
+            fclose (fclient->file);
+            fclient->file = NULL;
+            fclient->sendfile = 0;
         }
-        /* drop out of here if someone is ready */
-        ret = fserve_client_waiting();
-        if (ret)
-            return ret;
     }
-    return -1;
+    else
+#endif
+    if (client->pos == refbuf->len)
+    {
+        /* Grab a new chunk */
+        if (fclient->file)
+            bytes = fread (refbuf->data, 1, BUFSIZE, fclient->file);
+        else
+            bytes = 0;
+        if (bytes == 0)
+        {
+            if (refbuf->next == NULL)
+                return -1;
+            refbuf = refbuf->next;
+            client->refbuf->next = NULL;
+            refbuf_release (client->refbuf);
+            client->refbuf = refbuf;
+            bytes = refbuf->len;
+        }
+        refbuf->len = (unsigned int)bytes;
+        client->pos = 0;
+    }
+
+    /* Now try and send current chunk. */
+    if (client->pos < refbuf->len)
+        format_generic_write_to_client (client);
+
+    if (client->con->error)
+        return -1;
+    return 0;
 }
 
 static void *fserv_thread_function(void *arg)
 {
-    fserve_t *fclient, **trail;
-    size_t bytes;
-
-    (void)arg;
+    fserve_worker_t *worker = arg;
+    pollset_event_t events[FSERVE_EVENTS];
 
     while (1)
     {
-        if (wait_for_fds() < 0)
+        fserve_t *pending;
+        int count, i;
+
+        thread_spin_lock (&pending_lock);
+        if (run_fserv == 0 || (worker->active == NULL && worker->pending == NULL))
+        {
+            worker->running = 0;
+            thread_spin_unlock (&pending_lock);
             break;
+        }
+        pending = worker->pending;
+        worker->pending = NULL;
+        thread_spin_unlock (&pending_lock);
 
-        fclient = active_list;
-        trail = &active_list;
+        /* add any new clients here */
+        fserve_worker_add (worker, pending);
 
-        while (fclient)
+        if (worker->pollset == NULL)
         {
-            /* process this client, if it is ready */
-            if (fclient->ready)
+            /* nothing to wait on, so just try all of them now and again */
+            fserve_t *fclient = worker->active;
+
+            thread_sleep (20000);
+            while (fclient)
             {
-                client_t *client = fclient->client;
-                refbuf_t *refbuf = client->refbuf;
-                fclient->ready = 0;
-                if (client->pos == refbuf->len)
-                {
-                    /* Grab a new chunk */
-                    if (fclient->file)
-                        bytes = fread (refbuf->data, 1, BUFSIZE, fclient->file);
-                    else
-                        bytes = 0;
-                    if (bytes == 0)
-                    {
-                        if (refbuf->next == NULL)
-                        {
-                            fserve_t *to_go = fclient;
-                            fclient = fclient->next;
-                            *trail = fclient;
-                            fserve_client_destroy (to_go);
-                            fserve_clients--;
-                            client_tree_changed = 1;
-                            continue;
-                        }
-                        refbuf = refbuf->next;
-                        client->refbuf->next = NULL;
-                        refbuf_release (client->refbuf);
-                        client->refbuf = refbuf;
-                        bytes = refbuf->len;
-                    }
-                    refbuf->len = (unsigned int)bytes;
-                    client->pos = 0;
-                }
+                fserve_t *next = fclient->next;
 
-                /* Now try and send current chunk. */
-                format_generic_write_to_client (client);
-
-                if (client->con->error)
-                {
-                    fserve_t *to_go = fclient;
-                    fclient = fclient->next;
-                    *trail = fclient;
-                    fserve_clients--;
-                    fserve_client_destroy (to_go);
-                    client_tree_changed = 1;
-                    continue;
-                }
+                if (fserve_client_send (fclient) < 0)
+                    fserve_worker_remove (worker, fclient);
+                fclient = next;
             }
-            trail = &fclient->next;
-            fclient = fclient->next;
+            continue;
+        }
+
+        count = pollset_wait (worker->pollset, events, FSERVE_EVENTS, 200);
+        for (i = 0; i < count; i++)
+        {
+            fserve_t *fclient = events[i].userdata;
+
+            if (fclient == NULL)
+                continue; /* woken up for new clients */
+            if (fserve_client_send (fclient) < 0)
+                fserve_worker_remove (worker, fclient);
         }
     }
     ICECAST_LOG_DEBUG("fserve handler exit");
@@ -647,15 +670,27 @@ fail:
  */
 static void fserve_add_pending (fserve_t *fclient)
 {
+    fserve_worker_t *worker;
+
     thread_spin_lock (&pending_lock);
-    fclient->next = (fserve_t *)pending_list;
-    pending_list = fclient;
-    if (run_fserv == 0)
+    if (run_fserv == 0 || worker_count == 0)
     {
-        run_fserv = 1;
+        thread_spin_unlock (&pending_lock);
+        fserve_client_destroy (fclient);
+        return;
+    }
+    worker = &workers[next_worker++ % worker_count];
+    fclient->next = worker->pending;
+    worker->pending = fclient;
+    if (worker->running == 0)
+    {
+        worker->running = 1;
         ICECAST_LOG_DEBUG("fserve handler waking up");
-        thread_create("File Serving Thread", fserv_thread_function, NULL, THREAD_DETACHED);
+        if (thread_create("File Serving Thread", fserv_thread_function, worker, THREAD_DETACHED) == NULL)
+            worker->running = 0;
     }
+    else
+        pollset_wakeup (worker->pollset);
     thread_spin_unlock (&pending_lock);
 }
 
@@ -675,7 +710,16 @@ int fserve_add_client (client_t *client, FILE *file)
     }
     fclient->file = file;
     fclient->client = client;
-    fclient->ready = 0;
+#ifdef FSERVE_SENDFILE
+    /* plain sockets get the file handed over directly, from wherever
+     * a range request has moved the file position to */
+    if (file && client->con->tls == NULL)
+    {
+        fclient->offset = ftello (file);
+        if (fclient->offset >= 0)
+            fclient->sendfile = 1;
+    }
+#endif
     fserve_add_pending (fclient);
 
     return 0;
@@ -697,7 +741,6 @@ void fserve_add_client_callback (client_t *client, fserve_callback_t callback, v
     }
     fclient->file = NULL;
     fclient->client = client;
-    fclient->ready = 0;
     fclient->callback = callback;
     fclient->arg = arg;
 
@@ -14,6 +14,7 @@
 #define __FSERVE_H__
 
 #include <stdio.h>
+#include <sys/types.h>
 #include "cfgfile.h"
 
 typedef void (*fserve_callback_t)(client_t *, void *);
@@ -23,10 +24,12 @@ typedef struct _fserve_t
     client_t *client;
 
     FILE *file;
-    int ready;
+    int sendfile;       /* file is sent with sendfile() */
+    off_t offset;       /* position in file for sendfile() */
     void (*callback)(client_t *, void *);
     void *arg;
     struct _fserve_t *next;
+    struct _fserve_t *prev;
 } fserve_t;
 
 void fserve_initialize(void);
@@ -40,6 +40,7 @@ void global_initialize(void)
     global.master_relays = NULL;
     global.running = 0;
     global.clients = 0;
+    global.unclassified = 0;
     global.sources = 0;
     global.source_tree = avl_tree_new(source_compare_sources, NULL);
     thread_mutex_create(&_global_mutex);
@@ -33,6 +33,7 @@ typedef struct ice_global_tag
 
     int sources;
     int clients;
+    int unclassified;   /* clients whose request is still to come */
     int schedule_config_reread;
 
     avl_tree *source_tree;
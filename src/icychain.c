@@ -0,0 +1,129 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "icychain.h"
+
+
+void icychain_init(icychain_t *chain, unsigned int interval, uint64_t offset)
+{
+    memset(chain, 0, sizeof(icychain_t));
+    chain->interval = interval;
+    chain->offset = offset;
+}
+
+
+void icychain_clear(icychain_t *chain)
+{
+    refbuf_t *block = chain->head;
+
+    while (block) {
+        refbuf_t *to_go = block;
+
+        block = to_go->next;
+        to_go->next = NULL;
+        refbuf_release(to_go);
+    }
+    chain->head = chain->tail = NULL;
+    chain->size = 0;
+}
+
+
+/* always the full metadata goes in, as listeners come on to any block */
+void icychain_append(icychain_t *chain, refbuf_t *refbuf, unsigned int pos)
+{
+    while (pos < refbuf->len) {
+        refbuf_t *block = chain->tail;
+        unsigned int len = refbuf->len - pos;
+
+        if (block == NULL || chain->since == chain->interval) {
+            block = refbuf_new(chain->interval + ICY_METADATA_MAX);
+            block->len = 0;
+            if (chain->tail)
+                chain->tail->next = block;
+            else
+                chain->head = block;
+            chain->tail = block;
+            chain->since = 0;
+        }
+        if (len > chain->interval - chain->since)
+            len = chain->interval - chain->since;
+        memcpy(block->data + block->len, refbuf->data + pos, len);
+        block->len += len;
+        chain->since += len;
+        chain->size += len;
+        pos += len;
+
+        if (chain->since == chain->interval) {
+            const char *meta = "\0";
+            unsigned int meta_len = 1;
+
+            if (refbuf->associated) {
+                meta = refbuf->associated->data;
+                meta_len = refbuf->associated->len;
+            }
+            memcpy(block->data + block->len, meta, meta_len);
+            block->len += meta_len;
+            chain->size += meta_len;
+        }
+    }
+}
+
+
+void icychain_trim(icychain_t *chain, unsigned int keep, unsigned int limit)
+{
+    while (chain->head != chain->tail && refbuf_count(chain->head) == 1 &&
+            chain->size - chain->head->len >= keep) {
+        refbuf_t *to_go = chain->head;
+
+        chain->head = to_go->next;
+        chain->size -= to_go->len;
+        chain->offset += chain->interval;
+        to_go->next = NULL;
+        refbuf_release(to_go);
+    }
+    chain->lagging = chain->size > limit;
+}
+
+
+int icychain_in_phase(const icychain_t *chain, unsigned int interval, uint64_t offset)
+{
+    return chain->interval == interval && offset % interval == chain->offset % interval;
+}
+
+
+refbuf_t *icychain_block_at(const icychain_t *chain, uint64_t offset, uint64_t *start)
+{
+    refbuf_t *block = chain->head;
+    uint64_t at = chain->offset;
+
+    while (block && at < offset) {
+        block = block->next;
+        at += chain->interval;
+    }
+    if (block)
+        *start = at;
+    return block;
+}
+
+
+int icychain_unused(const icychain_t *chain)
+{
+    refbuf_t *block;
+
+    for (block = chain->head; block; block = block->next)
+        if (refbuf_count(block) > 1)
+            return 0;
+    return 1;
+}
@@ -0,0 +1,63 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* The stream as sent to listeners using one metadata interval. Each block
+ * holds an interval of mp3 followed by the metadata, so a listener moved
+ * on to a block has nothing left to work out. Where the metadata goes
+ * depends on where a listener started, so a listener can only follow a
+ * chain whose blocks start where its own intervals do, at offsets in the
+ * stream the same distance apart.
+ *
+ * Blocks are filled up as the stream comes in and released from the head
+ * once nobody is on them, like the source queue. Only the source thread
+ * changes a chain.
+ */
+
+#ifndef __ICYCHAIN_H__
+#define __ICYCHAIN_H__
+
+#include <stdint.h>
+
+#include "refbuf.h"
+
+/* largest metadata block, including the length byte */
+#define ICY_METADATA_MAX        (1 + 255*16)
+
+/* intervals larger than this are left to the per listener path */
+#define ICYCHAIN_INTERVAL_MAX   65536
+
+typedef struct icychain_tag {
+    unsigned int interval;
+    const char *mount;          /* for reporting */
+    uint64_t offset;            /* stream offset the head block starts at */
+    refbuf_t *head;
+    refbuf_t *tail;
+    unsigned int since;         /* mp3 in the tail block */
+    unsigned int size;          /* bytes held in the chain */
+    int lagging;                /* listeners still on head are dropped */
+} icychain_t;
+
+/* start an empty chain with the first block at the given stream offset */
+void      icychain_init(icychain_t *chain, unsigned int interval, uint64_t offset);
+/* release all the blocks, which nobody may be on */
+void      icychain_clear(icychain_t *chain);
+/* add the stream from pos in refbuf, with its metadata after each interval */
+void      icychain_append(icychain_t *chain, refbuf_t *refbuf, unsigned int pos);
+/* release blocks from the head nobody is on while at least keep bytes
+ * stay, listeners on the head are lagging once more than limit is held */
+void      icychain_trim(icychain_t *chain, unsigned int keep, unsigned int limit);
+/* whether a listener at the start of an interval at the stream offset has
+ * its intervals where the blocks of the chain start */
+int       icychain_in_phase(const icychain_t *chain, unsigned int interval, uint64_t offset);
+/* the first block starting at or after the stream offset, with where it
+ * starts, NULL if it is not in the chain yet */
+refbuf_t *icychain_block_at(const icychain_t *chain, uint64_t offset, uint64_t *start);
+/* whether nobody is on any of the blocks */
+int       icychain_unused(const icychain_t *chain);
+
+#endif  /* __ICYCHAIN_H__ */
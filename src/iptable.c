@@ -0,0 +1,367 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#else
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include "iptable.h"
+
+#define IPTABLE_INDEX_BITS  16
+#define IPTABLE_INDEX_SIZE  (1 << IPTABLE_INDEX_BITS)
+
+typedef struct iptable_range4_tag {
+    uint32_t first;
+    uint32_t last;
+} iptable_range4_t;
+
+typedef struct iptable_addr6_tag {
+    uint64_t hi;
+    uint64_t lo;
+} iptable_addr6_t;
+
+typedef struct iptable_range6_tag {
+    iptable_addr6_t first;
+    iptable_addr6_t last;
+} iptable_range6_t;
+
+struct iptable_tag {
+    iptable_range4_t *v4;
+    size_t v4_count;
+    size_t v4_allocated;
+
+    iptable_range6_t *v6;
+    size_t v6_count;
+    size_t v6_allocated;
+
+    /* v4_index[n] is the first range which ends at or after n << 16 */
+    uint32_t *v4_index;
+    int compiled;
+};
+
+/* parsed form of an address or prefix */
+typedef struct iptable_entry_tag {
+    int family;     /* 4 or 6 */
+    uint32_t v4;
+    iptable_addr6_t v6;
+    int prefix;
+} iptable_entry_t;
+
+
+static uint64_t iptable_load64 (const unsigned char *p)
+{
+    uint64_t ret = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+        ret = (ret << 8) | p[i];
+    return ret;
+}
+
+/* the ::ffff:a.b.c.d form is looked up as plain IPv4 */
+static int iptable_v4_mapped (const iptable_addr6_t *addr)
+{
+    return addr->hi == 0 && (addr->lo >> 32) == 0xffff;
+}
+
+static int iptable_parse (const char *str, iptable_entry_t *entry, int allow_prefix)
+{
+    char buf[64];
+    const char *slash = strchr (str, '/');
+    size_t len = slash ? (size_t)(slash - str) : strlen (str);
+    unsigned char addr[16];
+
+    if (len == 0 || len >= sizeof (buf))
+        return -1;
+    memcpy (buf, str, len);
+    buf[len] = '\0';
+
+    if (inet_pton (AF_INET, buf, addr) == 1)
+    {
+        entry->family = 4;
+        entry->v4 = ((uint32_t)addr[0] << 24) | ((uint32_t)addr[1] << 16) | ((uint32_t)addr[2] << 8) | addr[3];
+        entry->prefix = 32;
+    }
+    else if (inet_pton (AF_INET6, buf, addr) == 1)
+    {
+        entry->family = 6;
+        entry->v6.hi = iptable_load64 (addr);
+        entry->v6.lo = iptable_load64 (addr + 8);
+        entry->prefix = 128;
+    }
+    else
+        return -1;
+
+    if (slash)
+    {
+        char *end;
+        long prefix;
+
+        if (allow_prefix == 0 || slash[1] < '0' || slash[1] > '9')
+            return -1;
+        prefix = strtol (slash + 1, &end, 10);
+        if (*end || prefix > entry->prefix)
+            return -1;
+        entry->prefix = (int)prefix;
+    }
+
+    if (entry->family == 6 && iptable_v4_mapped (&entry->v6) && entry->prefix >= 96)
+    {
+        entry->family = 4;
+        entry->v4 = (uint32_t)entry->v6.lo;
+        entry->prefix -= 96;
+    }
+    return 0;
+}
+
+
+iptable_t *iptable_new (void)
+{
+    return calloc (1, sizeof (iptable_t));
+}
+
+void iptable_free (iptable_t *table)
+{
+    if (table == NULL)
+        return;
+    free (table->v4);
+    free (table->v6);
+    free (table->v4_index);
+    free (table);
+}
+
+static int iptable_add_v4 (iptable_t *table, uint32_t addr, int prefix)
+{
+    uint32_t hostmask = prefix == 0 ? 0xffffffff : ((uint32_t)1 << (32 - prefix)) - 1;
+
+    if (table->v4_count == table->v4_allocated)
+    {
+        size_t allocated = table->v4_allocated ? table->v4_allocated * 2 : 64;
+        iptable_range4_t *v4 = realloc (table->v4, allocated * sizeof (iptable_range4_t));
+
+        if (v4 == NULL)
+            return -1;
+        table->v4 = v4;
+        table->v4_allocated = allocated;
+    }
+    table->v4[table->v4_count].first = addr & ~hostmask;
+    table->v4[table->v4_count].last = addr | hostmask;
+    table->v4_count++;
+    return 0;
+}
+
+static int iptable_add_v6 (iptable_t *table, const iptable_addr6_t *addr, int prefix)
+{
+    iptable_addr6_t hostmask;
+    iptable_range6_t *range;
+
+    if (prefix == 0) {
+        hostmask.hi = hostmask.lo = UINT64_MAX;
+    } else if (prefix <= 64) {
+        hostmask.hi = prefix == 64 ? 0 : ((uint64_t)1 << (64 - prefix)) - 1;
+        hostmask.lo = UINT64_MAX;
+    } else {
+        hostmask.hi = 0;
+        hostmask.lo = prefix == 128 ? 0 : ((uint64_t)1 << (128 - prefix)) - 1;
+    }
+
+    if (table->v6_count == table->v6_allocated)
+    {
+        size_t allocated = table->v6_allocated ? table->v6_allocated * 2 : 16;
+        iptable_range6_t *v6 = realloc (table->v6, allocated * sizeof (iptable_range6_t));
+
+        if (v6 == NULL)
+            return -1;
+        table->v6 = v6;
+        table->v6_allocated = allocated;
+    }
+    range = &table->v6[table->v6_count++];
+    range->first.hi = addr->hi & ~hostmask.hi;
+    range->first.lo = addr->lo & ~hostmask.lo;
+    range->last.hi = addr->hi | hostmask.hi;
+    range->last.lo = addr->lo | hostmask.lo;
+    return 0;
+}
+
+int iptable_add (iptable_t *table, const char *entry)
+{
+    iptable_entry_t parsed;
+
+    if (table == NULL || entry == NULL || iptable_parse (entry, &parsed, 1) < 0)
+        return -1;
+    table->compiled = 0;
+    if (parsed.family == 4)
+        return iptable_add_v4 (table, parsed.v4, parsed.prefix);
+    return iptable_add_v6 (table, &parsed.v6, parsed.prefix);
+}
+
+
+static int iptable_cmp6 (const iptable_addr6_t *a, const iptable_addr6_t *b)
+{
+    if (a->hi != b->hi)
+        return a->hi < b->hi ? -1 : 1;
+    if (a->lo != b->lo)
+        return a->lo < b->lo ? -1 : 1;
+    return 0;
+}
+
+static int iptable_sort4 (const void *a, const void *b)
+{
+    const iptable_range4_t *ra = a, *rb = b;
+
+    if (ra->first != rb->first)
+        return ra->first < rb->first ? -1 : 1;
+    return 0;
+}
+
+static int iptable_sort6 (const void *a, const void *b)
+{
+    return iptable_cmp6 (&((const iptable_range6_t *)a)->first, &((const iptable_range6_t *)b)->first);
+}
+
+int iptable_compile (iptable_t *table)
+{
+    size_t i, out;
+    uint32_t block;
+
+    if (table == NULL)
+        return -1;
+
+    /* sort, then merge overlapping and adjacent ranges */
+    if (table->v4_count)
+    {
+        qsort (table->v4, table->v4_count, sizeof (iptable_range4_t), iptable_sort4);
+        for (i = 1, out = 0; i < table->v4_count; i++)
+        {
+            iptable_range4_t *cur = &table->v4[out];
+
+            if (cur->last == UINT32_MAX || table->v4[i].first <= cur->last + 1) {
+                if (table->v4[i].last > cur->last)
+                    cur->last = table->v4[i].last;
+            } else {
+                table->v4[++out] = table->v4[i];
+            }
+        }
+        table->v4_count = out + 1;
+    }
+    if (table->v6_count)
+    {
+        qsort (table->v6, table->v6_count, sizeof (iptable_range6_t), iptable_sort6);
+        for (i = 1, out = 0; i < table->v6_count; i++)
+        {
+            iptable_range6_t *cur = &table->v6[out];
+            iptable_addr6_t next = cur->last;
+
+            /* next is the address following the current range */
+            if (++next.lo == 0)
+                next.hi++;
+            if ((next.hi == 0 && next.lo == 0) || iptable_cmp6 (&table->v6[i].first, &next) <= 0) {
+                if (iptable_cmp6 (&table->v6[i].last, &cur->last) > 0)
+                    cur->last = table->v6[i].last;
+            } else {
+                table->v6[++out] = table->v6[i];
+            }
+        }
+        table->v6_count = out + 1;
+    }
+
+    if (table->v4_index == NULL)
+    {
+        table->v4_index = malloc ((IPTABLE_INDEX_SIZE + 1) * sizeof (uint32_t));
+        if (table->v4_index == NULL)
+            return -1;
+    }
+    for (block = 0, i = 0; block < IPTABLE_INDEX_SIZE; block++)
+    {
+        while (i < table->v4_count && table->v4[i].last < (block << (32 - IPTABLE_INDEX_BITS)))
+            i++;
+        table->v4_index[block] = (uint32_t)i;
+    }
+    table->v4_index[IPTABLE_INDEX_SIZE] = (uint32_t)table->v4_count;
+    table->compiled = 1;
+    return 0;
+}
+
+size_t iptable_ranges (const iptable_t *table)
+{
+    if (table == NULL)
+        return 0;
+    return table->v4_count + table->v6_count;
+}
+
+
+static int iptable_match_v4 (const iptable_t *table, uint32_t addr)
+{
+    uint32_t block = addr >> (32 - IPTABLE_INDEX_BITS);
+    size_t low = table->v4_index[block], high = table->v4_index[block + 1];
+
+    /* the range at high may still start within this block */
+    if (high >= table->v4_count)
+        high = table->v4_count;
+    else
+        high++;
+
+    /* find the last range starting at or before addr */
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+
+        if (table->v4[mid].first <= addr)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == 0)
+        return 0;
+    return addr <= table->v4[low - 1].last && addr >= table->v4[low - 1].first;
+}
+
+static int iptable_match_v6 (const iptable_t *table, const iptable_addr6_t *addr)
+{
+    size_t low = 0, high = table->v6_count;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+
+        if (iptable_cmp6 (&table->v6[mid].first, addr) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == 0)
+        return 0;
+    return iptable_cmp6 (addr, &table->v6[low - 1].last) <= 0;
+}
+
+int iptable_match (const iptable_t *table, const char *address)
+{
+    iptable_entry_t parsed;
+
+    if (address == NULL || iptable_parse (address, &parsed, 0) < 0)
+        return -1;
+    if (table == NULL || table->compiled == 0)
+        return 0;
+    if (parsed.family == 4)
+        return table->v4_count ? iptable_match_v4 (table, parsed.v4) : 0;
+    return table->v6_count ? iptable_match_v6 (table, &parsed.v6) : 0;
+}
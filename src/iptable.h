@@ -0,0 +1,40 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* A table of IPv4 and IPv6 addresses and prefixes (eg 10.0.0.0/8 or
+ * 2001:db8::/32) to check addresses against.
+ *
+ * Entries are added one at a time, then iptable_compile() turns them into
+ * sorted, merged address ranges. IPv4 lookups go through a table indexed
+ * by the top 16 bits of the address, so only the few ranges within that
+ * block need to be searched. A compiled table is only read, so it can be
+ * shared between threads.
+ */
+
+#ifndef __IPTABLE_H__
+#define __IPTABLE_H__
+
+#include <stddef.h>
+
+typedef struct iptable_tag iptable_t;
+
+iptable_t *iptable_new(void);
+void       iptable_free(iptable_t *table);
+
+/* returns 0 if added and -1 if entry is not an address or prefix */
+int        iptable_add(iptable_t *table, const char *entry);
+int        iptable_compile(iptable_t *table);
+
+/* number of ranges left after compiling */
+size_t     iptable_ranges(const iptable_t *table);
+
+/* returns 1 if the address is covered, 0 if not and -1 if address is not
+ * an address at all */
+int        iptable_match(const iptable_t *table, const char *address);
+
+#endif  /* __IPTABLE_H__ */
@@ -68,6 +68,7 @@
 #include "compat.h"
 #include "connection.h"
 #include "refbuf.h"
+#include "oggpage.h"
 #include "client.h"
 #include "slave.h"
 #include "stats.h"
@@ -127,6 +128,7 @@ void initialize_subsystems(void)
     connection_initialize();
     global_initialize();
     refbuf_initialize();
+    oggpage_initialize();
 
     xslt_initialize();
 #ifdef HAVE_CURL
@@ -138,11 +140,11 @@ void shutdown_subsystems(void)
 {
     event_shutdown();
     fserve_shutdown();
-    refbuf_shutdown();
     slave_shutdown();
     auth_shutdown();
     yp_shutdown();
     stats_shutdown();
+    refbuf_shutdown();
 
     global_shutdown();
     connection_shutdown();
@@ -20,11 +20,24 @@
 #include <unistd.h>
 
 #include "matchfile.h"
+#include "iptable.h"
 #include "logging.h"
 #include "util.h" /* for MAX_LINE_LEN and get_line() */
 #include "common/avl/avl.h"
+#include "common/thread/thread.h"
 #define CATMODULE "matchfile"
 
+/* The loaded contents of a file. Addresses and prefixes go into a compiled
+ * table, anything else is matched as an exact string. A reload builds a
+ * new one and swaps it in, lookups still using the old one keep a
+ * reference to it.
+ */
+typedef struct matchfile_db_tag {
+    size_t refcount; /* protected by the lock of the file */
+    avl_tree *contents;
+    iptable_t *addresses;
+} matchfile_db_t;
+
 struct matchfile_tag {
     /* reference counter */
     size_t refcount;
@@ -32,9 +45,10 @@ struct matchfile_tag {
     /* filename of input file */
     char *filename;
 
+    spin_t lock; /* protects file_recheck, file_mtime and db */
     time_t file_recheck;
     time_t file_mtime;
-    avl_tree *contents;
+    matchfile_db_t *db;
 };
 
 static int __func_free(void *x) {
@@ -47,17 +61,51 @@ static int __func_compare (void *arg, void *a, void *b) {
     return strcmp(b, a);
 }
 
+static void __db_free(matchfile_db_t *db) {
+    if (db->contents)
+        avl_tree_free(db->contents, __func_free);
+    iptable_free(db->addresses);
+    free(db);
+}
+
+static matchfile_db_t *__db_get(matchfile_t *file) {
+    matchfile_db_t *db;
+
+    thread_spin_lock(&file->lock);
+    db = file->db;
+    if (db)
+        db->refcount++;
+    thread_spin_unlock(&file->lock);
+    return db;
+}
+
+static void __db_release(matchfile_t *file, matchfile_db_t *db) {
+    size_t refcount;
+
+    if (!db)
+        return;
+    thread_spin_lock(&file->lock);
+    refcount = --db->refcount;
+    thread_spin_unlock(&file->lock);
+    if (!refcount)
+        __db_free(db);
+}
+
 static void __func_recheck(matchfile_t *file) {
     time_t now = time(NULL);
     struct stat file_stat;
     FILE *input = NULL;
-    avl_tree *new_contents;
+    matchfile_db_t *new_db, *old_db;
     char line[MAX_LINE_LEN];
 
-    if (now < file->file_recheck)
+    /* only one thread gets to look at the file */
+    thread_spin_lock(&file->lock);
+    if (now < file->file_recheck) {
+        thread_spin_unlock(&file->lock);
         return;
-
+    }
     file->file_recheck = now + 10;
+    thread_spin_unlock(&file->lock);
 
     if (stat(file->filename, &file_stat) < 0) {
         ICECAST_LOG_WARN("failed to check status of \"%s\": %s", file->filename, strerror(errno));
@@ -75,22 +123,42 @@ static void __func_recheck(matchfile_t *file) {
         return;
     }
 
-    new_contents = avl_tree_new(__func_compare, NULL);
+    new_db = calloc(1, sizeof(matchfile_db_t));
+    if (!new_db) {
+        fclose(input);
+        return;
+    }
+    new_db->refcount = 1;
+    new_db->contents = avl_tree_new(__func_compare, NULL);
+    new_db->addresses = iptable_new();
 
     while (get_line(input, line, MAX_LINE_LEN)) {
         char *str;
 
         if(!line[0] || line[0] == '#')
             continue;
+        if (iptable_add(new_db->addresses, line) == 0)
+            continue;
         str = strdup(line);
         if (str)
-            avl_insert(new_contents, str);
+            avl_insert(new_db->contents, str);
     }
 
     fclose(input);
 
-    if (file->contents) avl_tree_free(file->contents, __func_free);
-    file->contents = new_contents;
+    if (iptable_compile(new_db->addresses) < 0) {
+        ICECAST_LOG_ERROR("Failed to compile addresses of \"%s\"", file->filename);
+        iptable_free(new_db->addresses);
+        new_db->addresses = NULL;
+    }
+    ICECAST_LOG_DEBUG("Loaded \"%s\" with %lu address ranges", file->filename, (unsigned long)iptable_ranges(new_db->addresses));
+
+    thread_spin_lock(&file->lock);
+    old_db = file->db;
+    file->db = new_db;
+    thread_spin_unlock(&file->lock);
+
+    __db_release(file, old_db);
 }
 
 matchfile_t *matchfile_new(const char *filename) {
@@ -107,6 +175,7 @@ matchfile_t *matchfile_new(const char *filename) {
     ret->filename     = strdup(filename);
     ret->file_mtime   = 0;
     ret->file_recheck = 0;
+    thread_spin_create(&ret->lock);
 
     if (!ret->filename) {
         matchfile_release(ret);
@@ -137,8 +206,8 @@ int          matchfile_release(matchfile_t *file) {
     if (file->refcount)
         return 0;
 
-    if (file->contents)
-        avl_tree_free(file->contents, __func_free);
+    __db_release(file, file->db);
+    thread_spin_destroy(&file->lock);
     free(file->filename);
     free(file);
 
@@ -148,6 +217,8 @@ int          matchfile_release(matchfile_t *file) {
 /* we are not const char *key because of avl_get_by_key()... */
 int          matchfile_match(matchfile_t *file, const char *key) {
     void *result;
+    matchfile_db_t *db;
+    int ret;
 
     if (!file)
         return -1;
@@ -155,10 +226,17 @@ int          matchfile_match(matchfile_t *file, const char *key) {
     /* reload database if needed */
     __func_recheck(file);
 
-    if (!file->contents)
+    db = __db_get(file);
+    if (!db)
         return 0;
 
-    return avl_get_by_key(file->contents, (void*)key, &result) == 0 ? 1 : 0;
+    /* addresses can only match entries in the address table */
+    ret = iptable_match(db->addresses, key);
+    if (ret < 0)
+        ret = avl_get_by_key(db->contents, (void*)key, &result) == 0 ? 1 : 0;
+
+    __db_release(file, db);
+    return ret;
 }
 
 int          matchfile_match_allow_deny(matchfile_t *allow, matchfile_t *deny, const char *key) {
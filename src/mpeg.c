@@ -0,0 +1,215 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "mpeg.h"
+
+/* give up looking for frames after this much data without any */
+#define MPEG_SYNC_LIMIT     65536
+
+/* sync word, version, layer and samplerate stay the same in a stream */
+#define MPEG_FIXED_MASK     0xfffe0c00
+/* for ADTS also the profile and the channel configuration */
+#define ADTS_FIXED_MASK     0xfffffdc0
+
+/* bytes needed to check for a frame */
+#define MPEG_HEADER_SIZE(sync)  ((sync)->type == MPEG_TYPE_ADTS ? 7 : 4)
+
+/* kbit/s by bitrate index for MPEG-1 layer I, II, III then MPEG-2/2.5
+ * layer I and layer II/III */
+static const unsigned short mpeg_bitrates[5][16] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+    {0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+    {0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0},
+    {0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+    {0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0}
+};
+
+/* by version index, MPEG-2.5, reserved, MPEG-2, MPEG-1 */
+static const unsigned int mpeg_samplerates[4][3] = {
+    {11025, 12000,  8000},
+    {0, 0, 0},
+    {22050, 24000, 16000},
+    {44100, 48000, 32000}
+};
+
+/* by ADTS sampling frequency index */
+static const unsigned int adts_samplerates[16] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+    16000, 12000, 11025, 8000, 7350, 0, 0, 0
+};
+
+
+int mpeg_frame_header(const unsigned char *data, mpeg_frame_t *frame)
+{
+    uint32_t header = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+    unsigned int version = (header >> 19) & 3;
+    unsigned int layer = 4 - ((header >> 17) & 3);     /* 4 is reserved */
+    unsigned int bitrate_index = (header >> 12) & 15;
+    unsigned int samplerate_index = (header >> 10) & 3;
+    unsigned int padding = (header >> 9) & 1;
+    unsigned int table;
+
+    if ((header & 0xffe00000) != 0xffe00000 || version == 1 || layer == 4 ||
+            samplerate_index == 3 || (header & 3) == 2)
+        return -1;
+    /* MPEG-2.5 only has layer III */
+    if (version == 0 && layer != 3)
+        return -1;
+    /* free format frames cannot be measured without the next header */
+    if (bitrate_index == 0 || bitrate_index == 15)
+        return -1;
+
+    if (version == 3)
+        table = layer - 1;
+    else
+        table = layer == 1 ? 3 : 4;
+    frame->bitrate = mpeg_bitrates[table][bitrate_index] * 1000;
+    frame->samplerate = mpeg_samplerates[version][samplerate_index];
+    frame->channels = ((header >> 6) & 3) == 3 ? 1 : 2;
+
+    if (layer == 1)
+    {
+        frame->samples = 384;
+        frame->length = (12 * frame->bitrate / frame->samplerate + padding) * 4;
+    }
+    else
+    {
+        frame->samples = (layer == 3 && version != 3) ? 576 : 1152;
+        frame->length = frame->samples / 8 * frame->bitrate / frame->samplerate + padding;
+    }
+    return 0;
+}
+
+
+/* The samplerate of HE-AAC is the one of the core AAC, which is what the
+ * 1024 samples of a raw data block are at */
+int mpeg_adts_header(const unsigned char *data, mpeg_frame_t *frame)
+{
+    unsigned int samplerate_index = (data[2] >> 2) & 15;
+    unsigned int channels = ((data[2] & 1) << 2) | (data[3] >> 6);
+    unsigned int length = ((data[3] & 3) << 11) | (data[4] << 3) | (data[5] >> 5);
+    unsigned int header_length = (data[1] & 1) ? 7 : 9;
+
+    if (data[0] != 0xff || (data[1] & 0xf6) != 0xf0)
+        return -1;
+    if (adts_samplerates[samplerate_index] == 0 || length < header_length)
+        return -1;
+
+    frame->length = length;
+    frame->samples = ((data[6] & 3) + 1) * 1024;
+    frame->samplerate = adts_samplerates[samplerate_index];
+    /* 0 is for a channel layout given in the stream itself */
+    frame->channels = channels == 7 ? 8 : channels;
+    frame->bitrate = 0;
+    return 0;
+}
+
+
+void mpeg_sync_init(mpeg_sync_t *sync, mpeg_type_t type)
+{
+    memset(sync, 0, sizeof(mpeg_sync_t));
+    sync->type = type;
+}
+
+static int mpeg_sync_header(mpeg_sync_t *sync, const unsigned char *data, mpeg_frame_t *frame, uint32_t *fixed)
+{
+    uint32_t bits = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+
+    if (sync->type == MPEG_TYPE_ADTS)
+    {
+        *fixed = bits & ADTS_FIXED_MASK;
+        return mpeg_adts_header(data, frame);
+    }
+    *fixed = bits & MPEG_FIXED_MASK;
+    return mpeg_frame_header(data, frame);
+}
+
+/* check for a frame at data, with len bytes available from there. Until
+ * in sync a frame only counts if the header of the next one also follows
+ * it, unless that is beyond the data */
+static int mpeg_sync_frame(mpeg_sync_t *sync, const unsigned char *data, unsigned int len, mpeg_frame_t *frame)
+{
+    uint32_t fixed, next_fixed;
+    mpeg_frame_t next;
+
+    if (mpeg_sync_header(sync, data, frame, &fixed) < 0)
+        return -1;
+    if (sync->locked)
+        return fixed == sync->fixed ? 0 : -1;
+
+    if (frame->length + MPEG_HEADER_SIZE(sync) <= len)
+    {
+        if (mpeg_sync_header(sync, data + frame->length, &next, &next_fixed) < 0 || next_fixed != fixed)
+            return -1;
+        sync->locked = 1;
+        sync->fixed = fixed;
+    }
+    return 0;
+}
+
+void mpeg_sync_block(mpeg_sync_t *sync, const unsigned char *data, unsigned int len, mpeg_block_t *block)
+{
+    unsigned int pos = 0;
+
+    memset(block, 0, sizeof(mpeg_block_t));
+    if (sync->disabled)
+    {
+        block->length = len;
+        block->sync_point = 1;
+        return;
+    }
+
+    while (pos + MPEG_HEADER_SIZE(sync) <= len)
+    {
+        mpeg_frame_t frame;
+        const unsigned char *next;
+
+        if (mpeg_sync_frame(sync, data + pos, len - pos, &frame) == 0)
+        {
+            /* cut in front of the first frame after other data, so that
+             * the next block starts with it */
+            if (pos > 0 && block->frames == 0)
+                break;
+            if (pos + frame.length > len)
+            {
+                block->partial = frame.length;
+                break;
+            }
+            block->frames++;
+            block->samples += frame.samples;
+            block->samplerate = frame.samplerate;
+            block->channels = frame.channels;
+            sync->unsynced = 0;
+            pos += frame.length;
+            continue;
+        }
+        /* lost sync or not found yet, what follows the last frame of the
+         * block goes out with the next block */
+        sync->locked = 0;
+        if (block->frames)
+            break;
+        next = memchr(data + pos + 1, 0xff, len - pos - 1);
+        sync->unsynced += (next ? (unsigned int)(next - data) : len) - pos;
+        pos = next ? (unsigned int)(next - data) : len;
+        if (sync->unsynced > MPEG_SYNC_LIMIT)
+        {
+            sync->disabled = 1;
+            pos = len;
+            break;
+        }
+    }
+    block->length = pos;
+    block->sync_point = block->frames > 0 || sync->disabled;
+}
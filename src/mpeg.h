@@ -0,0 +1,69 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* Frame sync for MPEG audio streams, either MPEG-1/2 audio or AAC in ADTS
+ * frames.
+ *
+ * Blocks of stream data are looked through for frame headers, so that they
+ * can be cut at frame boundaries and the play time they hold is known.
+ * Once two frames have been found back to back the stream is taken to be
+ * in sync, after that each header is checked against the first one. A
+ * stream which does not sync within a reasonable amount of data is passed
+ * through as is.
+ */
+
+#ifndef __MPEG_H__
+#define __MPEG_H__
+
+#include <stdint.h>
+
+typedef enum mpeg_type_tag {
+    MPEG_TYPE_AUDIO,            /* layer I, II or III */
+    MPEG_TYPE_ADTS
+} mpeg_type_t;
+
+typedef struct mpeg_frame_tag {
+    unsigned int length;        /* bytes including the header */
+    unsigned int samples;
+    unsigned int samplerate;
+    unsigned int bitrate;       /* bits/s, 0 when not in the header */
+    unsigned int channels;
+} mpeg_frame_t;
+
+typedef struct mpeg_sync_tag {
+    mpeg_type_t type;
+    int disabled;               /* no frames found, data passes through */
+    int locked;
+    uint32_t fixed;             /* header bits shared by all frames */
+    unsigned long unsynced;     /* bytes seen since the last frame */
+} mpeg_sync_t;
+
+/* what mpeg_sync_block() found in a block */
+typedef struct mpeg_block_tag {
+    unsigned int length;        /* bytes which can go out, the rest is kept */
+    unsigned int frames;
+    unsigned int samples;
+    unsigned int samplerate;
+    unsigned int channels;
+    unsigned int partial;       /* full length of a frame cut off at the end */
+    int sync_point;             /* the block starts with a frame */
+} mpeg_block_t;
+
+/* decode the 4 byte header at data, returns 0 if it is a valid one */
+int  mpeg_frame_header(const unsigned char *data, mpeg_frame_t *frame);
+/* decode the 7 byte ADTS header at data, returns 0 if it is a valid one */
+int  mpeg_adts_header(const unsigned char *data, mpeg_frame_t *frame);
+
+void mpeg_sync_init(mpeg_sync_t *sync, mpeg_type_t type);
+/* find the frames in a block of stream data, which is to be cut after the
+ * last complete one. The data from block->length onwards, a frame which
+ * is not complete yet or a few bytes which may start one, is to be put in
+ * front of the next block */
+void mpeg_sync_block(mpeg_sync_t *sync, const unsigned char *data, unsigned int len, mpeg_block_t *block);
+
+#endif  /* __MPEG_H__ */
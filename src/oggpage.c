@@ -0,0 +1,115 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "oggpage.h"
+
+/* polynomial of the page checksum, the data is taken MSB first */
+#define OGGPAGE_CRC_POLY    0x04c11db7
+
+/* crc_table[k][i] is the checksum of byte i followed by k zero bytes */
+static uint32_t crc_table[8][256];
+
+
+void oggpage_initialize(void)
+{
+    unsigned int i, k;
+
+    for (i = 0; i < 256; i++)
+    {
+        uint32_t crc = (uint32_t)i << 24;
+
+        for (k = 0; k < 8; k++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ OGGPAGE_CRC_POLY : crc << 1;
+        crc_table[0][i] = crc;
+    }
+    for (k = 1; k < 8; k++)
+        for (i = 0; i < 256; i++)
+            crc_table[k][i] = (crc_table[k-1][i] << 8) ^ crc_table[0][crc_table[k-1][i] >> 24];
+}
+
+
+uint32_t oggpage_crc(uint32_t crc, const unsigned char *data, unsigned int len)
+{
+    while (len >= 8)
+    {
+        uint32_t a = crc ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                ((uint32_t)data[2] << 8) | data[3]);
+
+        crc = crc_table[7][a >> 24] ^ crc_table[6][(a >> 16) & 255] ^
+            crc_table[5][(a >> 8) & 255] ^ crc_table[4][a & 255] ^
+            crc_table[3][data[4]] ^ crc_table[2][data[5]] ^
+            crc_table[1][data[6]] ^ crc_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc << 8) ^ crc_table[0][(crc >> 24) ^ *data++];
+    return crc;
+}
+
+
+/* skip to the next byte which could start a capture pattern */
+static unsigned int oggpage_skip(const unsigned char *data, unsigned int len)
+{
+    const unsigned char *next = memchr(data + 1, 'O', len - 1);
+
+    return next ? (unsigned int)(next - data) : len;
+}
+
+int oggpage_check(const unsigned char *data, unsigned int len, unsigned int *length)
+{
+    static const unsigned char zero[4];
+    unsigned int header_len, body_len = 0, i;
+    uint32_t crc;
+
+    *length = 0;
+    if (len < 4)
+    {
+        /* a partial capture pattern is kept for the next read */
+        if (memcmp(data, "OggS", len) == 0)
+            return 0;
+        *length = oggpage_skip(data, len);
+        return -1;
+    }
+    if (memcmp(data, "OggS", 4) != 0 || (len > 4 && data[4] != 0))
+    {
+        *length = oggpage_skip(data, len);
+        return -1;
+    }
+    if (len < OGGPAGE_HEADER_MIN)
+        return 0;
+    header_len = OGGPAGE_HEADER_MIN + data[26];
+    if (len < header_len)
+        return 0;
+    for (i = OGGPAGE_HEADER_MIN; i < header_len; i++)
+        body_len += data[i];
+    if (len < header_len + body_len)
+    {
+        *length = header_len + body_len;
+        return 0;
+    }
+
+    /* the checksum is over the page with its own field taken as zero */
+    crc = oggpage_crc(0, data, 22);
+    crc = oggpage_crc(crc, zero, 4);
+    crc = oggpage_crc(crc, data + 26, header_len + body_len - 26);
+    if (crc != (data[22] | ((uint32_t)data[23] << 8) | ((uint32_t)data[24] << 16) | ((uint32_t)data[25] << 24)))
+    {
+        *length = oggpage_skip(data, len);
+        return -1;
+    }
+    *length = header_len + body_len;
+    return 1;
+}
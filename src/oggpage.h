@@ -0,0 +1,41 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* Ogg page framing without libogg.
+ *
+ * Pages are found in place in the data read from a source, so that they
+ * can be sliced out of the read buffer instead of being copied into the
+ * sync buffer of libogg and then out again. The page checksum is worked
+ * out 8 bytes at a time with slicing-by-8 tables, which are set up once
+ * by oggpage_initialize().
+ */
+
+#ifndef __OGGPAGE_H__
+#define __OGGPAGE_H__
+
+#include <stdint.h>
+
+/* 27 byte header, 255 lacing values of 255 bytes each */
+#define OGGPAGE_HEADER_MIN      27
+#define OGGPAGE_MAX             (OGGPAGE_HEADER_MIN + 255 + 255 * 255)
+
+void     oggpage_initialize(void);
+
+/* the CRC32 of Ogg pages, carried on from crc */
+uint32_t oggpage_crc(uint32_t crc, const unsigned char *data, unsigned int len);
+
+/* look for a page at the start of len bytes of data.
+ * Returns 1 with *length set to the length of the page when a page with
+ * a good checksum is there. Returns 0 when more data is needed, *length
+ * is then the length of the page if known or 0. Returns -1 when there is
+ * no page at the start, *length is then how much to skip before looking
+ * again.
+ */
+int      oggpage_check(const unsigned char *data, unsigned int len, unsigned int *length);
+
+#endif  /* __OGGPAGE_H__ */
@@ -0,0 +1,442 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#elif defined(HAVE_POLL)
+#include <sys/poll.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#include "pollset.h"
+#include "logging.h"
+
+#undef CATMODULE
+#define CATMODULE "pollset"
+
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_POLL)
+
+/* The wakeup descriptor is registered like any other socket with the
+ * address of the descriptor pair as userdata, so it can be told apart
+ * when reported. An eventfd is used if available, else a pipe.
+ */
+static void pollset_wakeup_close (pollset_t *pollset);
+static void pollset_wakeup_drain (pollset_t *pollset);
+
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+
+struct pollset_tag {
+    int epoll_fd;
+    int wakeup[2];
+};
+
+static unsigned int pollset_to_epoll (unsigned int events)
+{
+    unsigned int ret = 0;
+
+    if (events & POLLSET_READ)
+        ret |= EPOLLIN;
+    if (events & POLLSET_WRITE)
+        ret |= EPOLLOUT;
+    if (events & POLLSET_EDGE)
+        ret |= EPOLLET;
+    return ret;
+}
+
+pollset_t *pollset_new (void)
+{
+    pollset_t *pollset = calloc (1, sizeof (pollset_t));
+
+    if (pollset == NULL)
+        return NULL;
+    pollset->wakeup[0] = pollset->wakeup[1] = -1;
+    pollset->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+    if (pollset->epoll_fd < 0)
+    {
+        ICECAST_LOG_ERROR("unable to create epoll descriptor: %s", strerror (errno));
+        free (pollset);
+        return NULL;
+    }
+    return pollset;
+}
+
+void pollset_free (pollset_t *pollset)
+{
+    if (pollset == NULL)
+        return;
+    pollset_wakeup_close (pollset);
+    close (pollset->epoll_fd);
+    free (pollset);
+}
+
+int pollset_edge_triggered (pollset_t *pollset)
+{
+    return pollset ? 1 : 0;
+}
+
+int pollset_fd (pollset_t *pollset)
+{
+    return pollset->epoll_fd;
+}
+
+static int pollset_ctl (pollset_t *pollset, int op, sock_t sock, unsigned int events, void *userdata)
+{
+    struct epoll_event ev;
+
+    memset (&ev, 0, sizeof (ev));
+    ev.events = pollset_to_epoll (events);
+    ev.data.ptr = userdata;
+    if (epoll_ctl (pollset->epoll_fd, op, sock, &ev) < 0)
+    {
+        ICECAST_LOG_DEBUG("epoll_ctl %d on %d failed: %s", op, (int)sock, strerror (errno));
+        return -1;
+    }
+    return 0;
+}
+
+int pollset_add (pollset_t *pollset, sock_t sock, unsigned int events, void *userdata)
+{
+    return pollset_ctl (pollset, EPOLL_CTL_ADD, sock, events, userdata);
+}
+
+int pollset_modify (pollset_t *pollset, sock_t sock, unsigned int events, void *userdata)
+{
+    return pollset_ctl (pollset, EPOLL_CTL_MOD, sock, events, userdata);
+}
+
+int pollset_remove (pollset_t *pollset, sock_t sock)
+{
+    return pollset_ctl (pollset, EPOLL_CTL_DEL, sock, 0, NULL);
+}
+
+int pollset_wait (pollset_t *pollset, pollset_event_t *events, int max, int timeout)
+{
+    struct epoll_event ev[64];
+    int ret, i;
+
+    if (max > 64)
+        max = 64;
+    ret = epoll_wait (pollset->epoll_fd, ev, max, timeout);
+    if (ret < 0)
+        return errno == EINTR ? 0 : -1;
+    for (i = 0; i < ret; i++)
+    {
+        if (ev[i].data.ptr == pollset->wakeup)
+        {
+            pollset_wakeup_drain (pollset);
+            events[i].userdata = NULL;
+            events[i].events = POLLSET_WAKEUP;
+            continue;
+        }
+        events[i].userdata = ev[i].data.ptr;
+        events[i].events = 0;
+        if (ev[i].events & EPOLLIN)
+            events[i].events |= POLLSET_READ;
+        if (ev[i].events & EPOLLOUT)
+            events[i].events |= POLLSET_WRITE;
+        if (ev[i].events & (EPOLLERR|EPOLLHUP))
+            events[i].events |= POLLSET_ERROR;
+    }
+    return ret;
+}
+
+#elif defined(HAVE_POLL)
+
+typedef struct pollset_entry_tag {
+    sock_t sock;
+    unsigned int events;
+    void *userdata;
+} pollset_entry_t;
+
+struct pollset_tag {
+    pollset_entry_t *entries;
+    struct pollfd *ufds;
+    unsigned int count;
+    unsigned int allocated;
+    unsigned int next;      /* where to continue reporting from */
+    int wakeup[2];
+};
+
+pollset_t *pollset_new (void)
+{
+    pollset_t *pollset = calloc (1, sizeof (pollset_t));
+
+    if (pollset)
+        pollset->wakeup[0] = pollset->wakeup[1] = -1;
+    return pollset;
+}
+
+void pollset_free (pollset_t *pollset)
+{
+    if (pollset == NULL)
+        return;
+    pollset_wakeup_close (pollset);
+    free (pollset->entries);
+    free (pollset->ufds);
+    free (pollset);
+}
+
+int pollset_edge_triggered (pollset_t *pollset)
+{
+    (void)pollset;
+    return 0;
+}
+
+int pollset_fd (pollset_t *pollset)
+{
+    (void)pollset;
+    return -1;
+}
+
+static pollset_entry_t *pollset_find (pollset_t *pollset, sock_t sock)
+{
+    unsigned int i;
+
+    for (i = 0; i < pollset->count; i++)
+        if (pollset->entries[i].sock == sock)
+            return &pollset->entries[i];
+    return NULL;
+}
+
+int pollset_add (pollset_t *pollset, sock_t sock, unsigned int events, void *userdata)
+{
+    pollset_entry_t *entry;
+
+    if (pollset_find (pollset, sock))
+        return -1;
+    if (pollset->count == pollset->allocated)
+    {
+        unsigned int allocated = pollset->allocated ? pollset->allocated * 2 : 16;
+        pollset_entry_t *entries = realloc (pollset->entries, allocated * sizeof (pollset_entry_t));
+        struct pollfd *ufds;
+
+        if (entries == NULL)
+            return -1;
+        pollset->entries = entries;
+        ufds = realloc (pollset->ufds, allocated * sizeof (struct pollfd));
+        if (ufds == NULL)
+            return -1;
+        pollset->ufds = ufds;
+        pollset->allocated = allocated;
+    }
+    entry = &pollset->entries[pollset->count++];
+    entry->sock = sock;
+    entry->events = events;
+    entry->userdata = userdata;
+    return 0;
+}
+
+int pollset_modify (pollset_t *pollset, sock_t sock, unsigned int events, void *userdata)
+{
+    pollset_entry_t *entry = pollset_find (pollset, sock);
+
+    if (entry == NULL)
+        return -1;
+    entry->events = events;
+    entry->userdata = userdata;
+    return 0;
+}
+
+int pollset_remove (pollset_t *pollset, sock_t sock)
+{
+    pollset_entry_t *entry = pollset_find (pollset, sock);
+
+    if (entry == NULL)
+        return -1;
+    pollset->count--;
+    *entry = pollset->entries[pollset->count];
+    return 0;
+}
+
+int pollset_wait (pollset_t *pollset, pollset_event_t *events, int max, int timeout)
+{
+    unsigned int i, count = pollset->count;
+    int ret, found = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        pollset->ufds[i].fd = pollset->entries[i].sock;
+        pollset->ufds[i].events = 0;
+        if (pollset->entries[i].events & POLLSET_READ)
+            pollset->ufds[i].events |= POLLIN;
+        if (pollset->entries[i].events & POLLSET_WRITE)
+            pollset->ufds[i].events |= POLLOUT;
+        pollset->ufds[i].revents = 0;
+    }
+    ret = poll (pollset->ufds, count, timeout);
+    if (ret <= 0)
+        return (ret < 0 && errno != EINTR) ? -1 : 0;
+
+    /* report in round robin order so that none get starved if there are
+     * more ready than the caller takes */
+    if (pollset->next >= count)
+        pollset->next = 0;
+    for (i = 0; i < count && found < max; i++)
+    {
+        unsigned int idx = (pollset->next + i) % count;
+        short revents = pollset->ufds[idx].revents;
+
+        if (revents == 0)
+            continue;
+        if (pollset->entries[idx].userdata == pollset->wakeup)
+        {
+            pollset_wakeup_drain (pollset);
+            events[found].userdata = NULL;
+            events[found].events = POLLSET_WAKEUP;
+            found++;
+            continue;
+        }
+        events[found].userdata = pollset->entries[idx].userdata;
+        events[found].events = 0;
+        if (revents & POLLIN)
+            events[found].events |= POLLSET_READ;
+        if (revents & POLLOUT)
+            events[found].events |= POLLSET_WRITE;
+        if (revents & (POLLERR|POLLHUP|POLLNVAL))
+            events[found].events |= POLLSET_ERROR;
+        found++;
+    }
+    pollset->next = (pollset->next + i) % count;
+    return found;
+}
+
+#endif
+
+#if defined(HAVE_SYS_EPOLL_H) || defined(HAVE_POLL)
+
+int pollset_wakeup_enable (pollset_t *pollset)
+{
+    if (pollset->wakeup[0] >= 0)
+        return 0;
+#ifdef HAVE_SYS_EVENTFD_H
+    pollset->wakeup[0] = pollset->wakeup[1] = eventfd (0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (pollset->wakeup[0] < 0)
+        return -1;
+#else
+    if (pipe (pollset->wakeup) < 0)
+    {
+        pollset->wakeup[0] = pollset->wakeup[1] = -1;
+        return -1;
+    }
+    fcntl (pollset->wakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl (pollset->wakeup[1], F_SETFL, O_NONBLOCK);
+#endif
+    if (pollset_add (pollset, pollset->wakeup[0], POLLSET_READ, pollset->wakeup) < 0)
+    {
+        pollset_wakeup_close (pollset);
+        return -1;
+    }
+    return 0;
+}
+
+void pollset_wakeup (pollset_t *pollset)
+{
+    ssize_t ret;
+
+    if (pollset == NULL || pollset->wakeup[1] < 0)
+        return;
+#ifdef HAVE_SYS_EVENTFD_H
+    {
+        uint64_t one = 1;
+        ret = write (pollset->wakeup[1], &one, sizeof (one));
+    }
+#else
+    ret = write (pollset->wakeup[1], "", 1);
+#endif
+    (void)ret; /* already pending if the counter or pipe is full */
+}
+
+static void pollset_wakeup_drain (pollset_t *pollset)
+{
+    char buf[64];
+
+    while (read (pollset->wakeup[0], buf, sizeof (buf)) > 0)
+        ;
+}
+
+static void pollset_wakeup_close (pollset_t *pollset)
+{
+    if (pollset->wakeup[0] < 0)
+        return;
+    if (pollset->wakeup[1] != pollset->wakeup[0])
+        close (pollset->wakeup[1]);
+    close (pollset->wakeup[0]);
+    pollset->wakeup[0] = pollset->wakeup[1] = -1;
+}
+
+#else
+
+pollset_t *pollset_new (void)
+{
+    return NULL;
+}
+
+void pollset_free (pollset_t *pollset)
+{
+    (void)pollset;
+}
+
+int pollset_edge_triggered (pollset_t *pollset)
+{
+    (void)pollset;
+    return 0;
+}
+
+int pollset_fd (pollset_t *pollset)
+{
+    (void)pollset;
+    return -1;
+}
+
+int pollset_wakeup_enable (pollset_t *pollset)
+{
+    return -1;
+}
+
+void pollset_wakeup (pollset_t *pollset)
+{
+}
+
+int pollset_add (pollset_t *pollset, sock_t sock, unsigned int events, void *userdata)
+{
+    return -1;
+}
+
+int pollset_modify (pollset_t *pollset, sock_t sock, unsigned int events, void *userdata)
+{
+    return -1;
+}
+
+int pollset_remove (pollset_t *pollset, sock_t sock)
+{
+    return -1;
+}
+
+int pollset_wait (pollset_t *pollset, pollset_event_t *events, int max, int timeout)
+{
+    return -1;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* A set of sockets to wait on for readiness.
+ *
+ * Sockets stay registered between waits, so only the sockets reported
+ * as ready need to be looked at.  epoll is used where available, else
+ * this falls back to poll(), in which case edge triggering is not
+ * available and every ready socket is reported on each wait.
+ */
+
+#ifndef __POLLSET_H__
+#define __POLLSET_H__
+
+#include "common/net/sock.h"
+
+#define POLLSET_READ    0x01
+#define POLLSET_WRITE   0x02
+#define POLLSET_ERROR   0x04    /* reported only, hangup or error on the socket */
+#define POLLSET_EDGE    0x08    /* only report changes of state, if supported */
+#define POLLSET_WAKEUP  0x10    /* reported only, pollset_wakeup() was called */
+
+typedef struct pollset_tag pollset_t;
+
+typedef struct pollset_event_tag {
+    void *userdata;
+    unsigned int events;
+} pollset_event_t;
+
+/* returns NULL if there is no way to wait on sockets on this platform */
+pollset_t *pollset_new(void);
+void pollset_free(pollset_t *pollset);
+
+/* non-zero if POLLSET_EDGE is honoured */
+int pollset_edge_triggered(pollset_t *pollset);
+
+/* descriptor which is readable while events are pending, so a pollset
+ * can be waited on as part of another one. -1 if not available */
+int pollset_fd(pollset_t *pollset);
+
+/* allow other threads to interrupt a wait, the wait then returns an event
+ * with POLLSET_WAKEUP set and no userdata */
+int pollset_wakeup_enable(pollset_t *pollset);
+void pollset_wakeup(pollset_t *pollset);
+
+int pollset_add(pollset_t *pollset, sock_t sock, unsigned int events, void *userdata);
+int pollset_modify(pollset_t *pollset, sock_t sock, unsigned int events, void *userdata);
+int pollset_remove(pollset_t *pollset, sock_t sock);
+
+/* wait up to timeout ms (-1 forever) and fill in up to max events.
+ * returns the number of events, 0 on timeout or -1 on error
+ */
+int pollset_wait(pollset_t *pollset, pollset_event_t *events, int max, int timeout);
+
+#endif  /* __POLLSET_H__ */
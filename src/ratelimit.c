@@ -0,0 +1,183 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "common/thread/thread.h"
+
+#include "ratelimit.h"
+
+/* number of slots, a power of 2 */
+#define RATELIMIT_SLOTS     65536
+/* tokens are kept in 1/16ths so slow rates still refill smoothly */
+#define RATELIMIT_SCALE     16
+#define RATELIMIT_MAX_BURST (0xffff / RATELIMIT_SCALE)
+/* how far in ms another thread may be ahead with its clock */
+#define RATELIMIT_SKEW      1000
+
+/* slot layout: address tag in the top 16 bits, then 16 bits of tokens and
+ * the low 32 bits of the time of the last refill in ms */
+#define SLOT_TAG(s)         ((uint32_t)((s) >> 48))
+#define SLOT_TOKENS(s)      ((uint32_t)((s) >> 32) & 0xffff)
+#define SLOT_STAMP(s)       ((uint32_t)(s))
+#define SLOT_MAKE(t,k,s)    (((uint64_t)(t) << 48) | ((uint64_t)(k) << 32) | (uint64_t)(s))
+
+struct ratelimit_tag {
+    unsigned int rate;
+    unsigned int burst;
+    uint64_t dropped;
+#ifndef HAVE_ATOMIC_BUILTINS_64
+    spin_t lock;
+#endif
+    uint64_t slots[RATELIMIT_SLOTS];
+};
+
+
+ratelimit_t *ratelimit_new (unsigned int rate, unsigned int burst)
+{
+    ratelimit_t *limit;
+
+    if (rate == 0)
+        return NULL;
+    limit = calloc (1, sizeof (ratelimit_t));
+    if (limit == NULL)
+        return NULL;
+    if (burst == 0)
+        burst = rate;
+    if (burst > RATELIMIT_MAX_BURST)
+        burst = RATELIMIT_MAX_BURST;
+    limit->rate = rate;
+    limit->burst = burst;
+#ifndef HAVE_ATOMIC_BUILTINS_64
+    thread_spin_create (&limit->lock);
+#endif
+    return limit;
+}
+
+void ratelimit_free (ratelimit_t *limit)
+{
+    if (limit == NULL)
+        return;
+#ifndef HAVE_ATOMIC_BUILTINS_64
+    thread_spin_destroy (&limit->lock);
+#endif
+    free (limit);
+}
+
+/* FNV-1a over the address as text, this saves parsing it */
+static uint64_t ratelimit_hash (const char *address)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    while (*address)
+    {
+        hash ^= (unsigned char)*address++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* work out the new state of a slot, returns 1 if the connection is allowed */
+static int ratelimit_update (ratelimit_t *limit, uint64_t slot, uint32_t tag, uint32_t now, uint64_t *updated)
+{
+    uint32_t full = limit->burst * RATELIMIT_SCALE;
+    uint32_t tokens, stamp;
+
+    if (SLOT_TAG (slot) != tag)
+    {
+        /* free slot or one of another address, start with a full bucket */
+        tokens = full;
+        stamp = now;
+    }
+    else
+    {
+        uint32_t elapsed = now - SLOT_STAMP (slot);
+        uint64_t add;
+
+        /* another thread may have been a bit ahead, else the slot was last
+         * used so long ago that the ms clock has wrapped round since */
+        if ((int32_t)elapsed < 0)
+            elapsed = (int32_t)elapsed > -RATELIMIT_SKEW ? 0 : UINT32_MAX;
+        add = (uint64_t)elapsed * limit->rate * RATELIMIT_SCALE / 1000;
+
+        tokens = SLOT_TOKENS (slot);
+        stamp = SLOT_STAMP (slot);
+        if (add + tokens >= full)
+        {
+            tokens = full;
+            stamp = now;
+        }
+        else if (add)
+        {
+            tokens += (uint32_t)add;
+            /* keep the part of a token not yet earned */
+            stamp += (uint32_t)(add * 1000 / ((uint64_t)limit->rate * RATELIMIT_SCALE));
+        }
+    }
+
+    if (tokens < RATELIMIT_SCALE)
+    {
+        *updated = SLOT_MAKE (tag, tokens, stamp);
+        return 0;
+    }
+    *updated = SLOT_MAKE (tag, tokens - RATELIMIT_SCALE, stamp);
+    return 1;
+}
+
+int ratelimit_allow (ratelimit_t *limit, const char *address, uint64_t now)
+{
+    uint64_t hash, *slot, old, updated;
+    uint32_t tag;
+    int allow;
+
+    if (limit == NULL || address == NULL)
+        return 1;
+
+    hash = ratelimit_hash (address);
+    slot = &limit->slots[hash & (RATELIMIT_SLOTS - 1)];
+    tag = (uint32_t)(hash >> 48) | 1; /* never 0, which an unused slot has */
+
+#ifdef HAVE_ATOMIC_BUILTINS_64
+    old = __atomic_load_n (slot, __ATOMIC_RELAXED);
+    do {
+        allow = ratelimit_update (limit, old, tag, (uint32_t)now, &updated);
+    } while (!__atomic_compare_exchange_n (slot, &old, updated, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    if (!allow)
+        __atomic_add_fetch (&limit->dropped, 1, __ATOMIC_RELAXED);
+#else
+    thread_spin_lock (&limit->lock);
+    old = *slot;
+    allow = ratelimit_update (limit, old, tag, (uint32_t)now, &updated);
+    *slot = updated;
+    if (!allow)
+        limit->dropped++;
+    thread_spin_unlock (&limit->lock);
+#endif
+    return allow;
+}
+
+uint64_t ratelimit_dropped (ratelimit_t *limit)
+{
+    uint64_t dropped;
+
+    if (limit == NULL)
+        return 0;
+#ifdef HAVE_ATOMIC_BUILTINS_64
+    dropped = __atomic_load_n (&limit->dropped, __ATOMIC_RELAXED);
+#else
+    thread_spin_lock (&limit->lock);
+    dropped = limit->dropped;
+    thread_spin_unlock (&limit->lock);
+#endif
+    return dropped;
+}
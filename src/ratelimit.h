@@ -0,0 +1,37 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* Per address token buckets limiting how often a client may connect.
+ *
+ * The table has a fixed number of slots, each holding the bucket of one
+ * address packed into a single word which is updated with compare and
+ * swap, so checks from several threads do not need a lock. An address
+ * landing on a slot used by another one takes it over with a full
+ * bucket, which keeps the memory fixed at the cost of being lenient
+ * when the table is crowded.
+ */
+
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__
+
+#include <stdint.h>
+
+typedef struct ratelimit_tag ratelimit_t;
+
+/* rate is in connections per second, burst the most allowed at once.
+ * returns NULL if rate is 0 */
+ratelimit_t *ratelimit_new(unsigned int rate, unsigned int burst);
+void         ratelimit_free(ratelimit_t *limit);
+
+/* returns 1 if address may connect at time now (in ms), 0 if it is over
+ * its limit, in which case the drop counter is increased */
+int          ratelimit_allow(ratelimit_t *limit, const char *address, uint64_t now);
+
+uint64_t     ratelimit_dropped(ratelimit_t *limit);
+
+#endif  /* __RATELIMIT_H__ */
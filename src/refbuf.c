@@ -22,48 +22,405 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+
+#include "common/thread/thread.h"
 
 #include "refbuf.h"
+#include "stats.h"
 
 #define CATMODULE "refbuf"
 
 #include "logging.h"
 
+/* Buffers are referenced from several threads at once (listener threads,
+ * file serving, other mounts), so the reference count is updated
+ * atomically. Taking a reference needs no ordering as the caller already
+ * holds one, dropping one is a release so that all use of the buffer is
+ * done before whoever drops the last reference frees it. Without the
+ * builtins the count is updated under lock.
+ */
+#ifndef HAVE_ATOMIC_BUILTINS
+static spin_t refbuf_lock;
+#endif
+
+/* Buffers are allocated with the data following the header in the same
+ * block. The common sizes are kept on free lists for reuse, a small one
+ * per thread which is topped up from, or spills over into, a shared one.
+ * The classes are for the mp3 read size, the per-client buffer (also the
+ * size of the EBML slices) and Ogg pages, anything larger is allocated
+ * as is and freed on release.
+ */
+#define REFBUF_CLASSES          5
+#define REFBUF_CACHE_MAX        64      /* per thread and class */
+#define REFBUF_CACHE_BATCH      32      /* moved to/from the shared pool in one go */
+#define REFBUF_POOL_MAX         1024    /* shared, per class */
+
+static const unsigned int refbuf_class_size[REFBUF_CLASSES] = {
+    0, 256, 1400, PER_CLIENT_REFBUF_SIZE, 8192
+};
+
+typedef struct refbuf_cache_tag {
+    refbuf_t *free[REFBUF_CLASSES];
+    unsigned int count[REFBUF_CLASSES];
+    unsigned long hits;
+    unsigned long misses;
+    struct refbuf_cache_tag *next;
+} refbuf_cache_t;
+
+static struct {
+    refbuf_t *free;
+    unsigned int count;
+} refbuf_pool[REFBUF_CLASSES];
+
+static spin_t refbuf_pool_lock;         /* for the shared pool and cache list */
+static pthread_key_t refbuf_cache_key;
+static refbuf_cache_t *refbuf_caches;
+static unsigned long refbuf_retired_hits, refbuf_retired_misses;
+static unsigned long refbuf_reported_hits, refbuf_reported_misses;
+static int refbuf_pool_active;
+
+
+static void refbuf_free_list (refbuf_t *refbuf)
+{
+    while (refbuf)
+    {
+        refbuf_t *next = refbuf->next;
+        free (refbuf);
+        refbuf = next;
+    }
+}
+
+/* hand back the buffers of a thread which is going away */
+static void refbuf_cache_release (void *arg)
+{
+    refbuf_cache_t *cache = arg, **trail;
+    int i;
+
+    thread_spin_lock (&refbuf_pool_lock);
+    for (i = 0; i < REFBUF_CLASSES; i++)
+    {
+        while (cache->free[i] && refbuf_pool[i].count < REFBUF_POOL_MAX)
+        {
+            refbuf_t *refbuf = cache->free[i];
+
+            cache->free[i] = refbuf->next;
+            refbuf->next = refbuf_pool[i].free;
+            refbuf_pool[i].free = refbuf;
+            refbuf_pool[i].count++;
+        }
+    }
+    refbuf_retired_hits += cache->hits;
+    refbuf_retired_misses += cache->misses;
+    for (trail = &refbuf_caches; *trail; trail = &(*trail)->next)
+    {
+        if (*trail == cache)
+        {
+            *trail = cache->next;
+            break;
+        }
+    }
+    thread_spin_unlock (&refbuf_pool_lock);
+
+    for (i = 0; i < REFBUF_CLASSES; i++)
+        refbuf_free_list (cache->free[i]);
+    free (cache);
+}
+
+static refbuf_cache_t *refbuf_cache_get (void)
+{
+    refbuf_cache_t *cache;
+
+    if (refbuf_pool_active == 0)
+        return NULL;
+    cache = pthread_getspecific (refbuf_cache_key);
+    if (cache == NULL)
+    {
+        cache = calloc (1, sizeof (refbuf_cache_t));
+        if (cache == NULL)
+            return NULL;
+        pthread_setspecific (refbuf_cache_key, cache);
+        thread_spin_lock (&refbuf_pool_lock);
+        cache->next = refbuf_caches;
+        refbuf_caches = cache;
+        thread_spin_unlock (&refbuf_pool_lock);
+    }
+    return cache;
+}
+
+static int refbuf_class (unsigned int size)
+{
+    int i;
+
+    for (i = 0; i < REFBUF_CLASSES; i++)
+        if (size <= refbuf_class_size[i])
+            return i;
+    return -1;
+}
+
+/* only buffers allocated at a class size are put on the free lists */
+static int refbuf_pooled_class (unsigned int capacity)
+{
+    int i = refbuf_class (capacity);
+
+    if (i >= 0 && refbuf_class_size[i] == capacity)
+        return i;
+    return -1;
+}
+
+static refbuf_t *refbuf_pool_get (refbuf_cache_t *cache, int class)
+{
+    refbuf_t *refbuf;
+
+    if (cache->free[class] == NULL)
+    {
+        /* top up from the shared pool */
+        thread_spin_lock (&refbuf_pool_lock);
+        while (refbuf_pool[class].free && cache->count[class] < REFBUF_CACHE_BATCH)
+        {
+            refbuf = refbuf_pool[class].free;
+            refbuf_pool[class].free = refbuf->next;
+            refbuf_pool[class].count--;
+            refbuf->next = cache->free[class];
+            cache->free[class] = refbuf;
+            cache->count[class]++;
+        }
+        thread_spin_unlock (&refbuf_pool_lock);
+        if (cache->free[class] == NULL)
+            return NULL;
+    }
+    refbuf = cache->free[class];
+    cache->free[class] = refbuf->next;
+    cache->count[class]--;
+    return refbuf;
+}
+
+static void refbuf_pool_put (refbuf_cache_t *cache, int class, refbuf_t *refbuf)
+{
+    refbuf->next = cache->free[class];
+    cache->free[class] = refbuf;
+    cache->count[class]++;
+    if (cache->count[class] > REFBUF_CACHE_MAX)
+    {
+        refbuf_t *spill = NULL;
+
+        /* move a batch over to the shared pool, free any it has no room for */
+        thread_spin_lock (&refbuf_pool_lock);
+        while (cache->count[class] > REFBUF_CACHE_MAX - REFBUF_CACHE_BATCH)
+        {
+            refbuf = cache->free[class];
+            cache->free[class] = refbuf->next;
+            cache->count[class]--;
+            if (refbuf_pool[class].count < REFBUF_POOL_MAX)
+            {
+                refbuf->next = refbuf_pool[class].free;
+                refbuf_pool[class].free = refbuf;
+                refbuf_pool[class].count++;
+            }
+            else
+            {
+                refbuf->next = spill;
+                spill = refbuf;
+            }
+        }
+        thread_spin_unlock (&refbuf_pool_lock);
+        refbuf_free_list (spill);
+    }
+}
+
 
 void refbuf_initialize(void)
 {
+#ifndef HAVE_ATOMIC_BUILTINS
+    thread_spin_create (&refbuf_lock);
+#endif
+    thread_spin_create (&refbuf_pool_lock);
+    if (pthread_key_create (&refbuf_cache_key, refbuf_cache_release) == 0)
+        refbuf_pool_active = 1;
 }
 
 void refbuf_shutdown(void)
 {
+    int i;
+
+    if (refbuf_pool_active)
+    {
+        refbuf_pool_active = 0;
+        pthread_setspecific (refbuf_cache_key, NULL);
+        while (refbuf_caches)
+            refbuf_cache_release (refbuf_caches);
+        pthread_key_delete (refbuf_cache_key);
+    }
+    for (i = 0; i < REFBUF_CLASSES; i++)
+    {
+        refbuf_free_list (refbuf_pool[i].free);
+        refbuf_pool[i].free = NULL;
+        refbuf_pool[i].count = 0;
+    }
+    thread_spin_destroy (&refbuf_pool_lock);
+#ifndef HAVE_ATOMIC_BUILTINS
+    thread_spin_destroy (&refbuf_lock);
+#endif
+}
+
+/* publish the pool counters if they have changed since last time */
+void refbuf_stats(void)
+{
+    unsigned long hits, misses;
+    refbuf_cache_t *cache;
+
+    thread_spin_lock (&refbuf_pool_lock);
+    hits = refbuf_retired_hits;
+    misses = refbuf_retired_misses;
+    for (cache = refbuf_caches; cache; cache = cache->next)
+    {
+        hits += cache->hits;
+        misses += cache->misses;
+    }
+    thread_spin_unlock (&refbuf_pool_lock);
+
+    if (hits != refbuf_reported_hits)
+        stats_event_args (NULL, "refbuf_pool_hits", "%lu", hits);
+    if (misses != refbuf_reported_misses)
+        stats_event_args (NULL, "refbuf_pool_misses", "%lu", misses);
+    refbuf_reported_hits = hits;
+    refbuf_reported_misses = misses;
 }
 
 refbuf_t *refbuf_new (unsigned int size)
 {
-    refbuf_t *refbuf;
+    refbuf_cache_t *cache = refbuf_cache_get ();
+    refbuf_t *refbuf = NULL;
+    unsigned int capacity = size;
+    int class = refbuf_class (size);
 
-    refbuf = (refbuf_t *)malloc(sizeof(refbuf_t));
-    if (refbuf == NULL)
-        abort();
-    refbuf->data = NULL;
-    if (size)
+    if (cache && class >= 0)
     {
-        refbuf->data = malloc (size);
-        if (refbuf->data == NULL)
+        capacity = refbuf_class_size[class];
+        refbuf = refbuf_pool_get (cache, class);
+    }
+    if (refbuf)
+        cache->hits++;
+    else
+    {
+        refbuf = (refbuf_t *)malloc(sizeof(refbuf_t) + capacity);
+        if (refbuf == NULL)
             abort();
+        if (cache)
+            cache->misses++;
     }
+    refbuf->data = size ? (char *)(refbuf + 1) : NULL;
+    refbuf->_capacity = capacity;
     refbuf->len = size;
     refbuf->sync_point = 0;
+    refbuf->duration = 0;
     refbuf->_count = 1;
     refbuf->next = NULL;
     refbuf->associated = NULL;
+    refbuf->_parent = NULL;
 
     return refbuf;
 }
 
+/* a buffer for part of the data of another one, which is kept for as
+ * long as the slice is */
+refbuf_t *refbuf_new_slice (refbuf_t *parent, unsigned int offset, unsigned int len)
+{
+    refbuf_t *refbuf = refbuf_new (0);
+
+    refbuf_addref (parent);
+    refbuf->_parent = parent;
+    refbuf->data = parent->data + offset;
+    refbuf->len = len;
+
+    return refbuf;
+}
+
+/* extend a slice over the one following it in the same parent, the next
+ * slice is left for the caller to release. returns 0 if they were joined,
+ * -1 if the data is not contiguous.
+ */
+int refbuf_join_slice (refbuf_t *self, refbuf_t *next)
+{
+    if (self->_parent == NULL || self->_parent != next->_parent)
+        return -1;
+    if (self->data + self->len != next->data)
+        return -1;
+    self->len += next->len;
+    return 0;
+}
+
+/* change the size of the data block, like realloc the contents are kept.
+ * returns 0 on success, -1 if memory could not be allocated.
+ */
+int refbuf_resize(refbuf_t *self, unsigned int size)
+{
+    char *inline_data = (char *)(self + 1);
+    char *data;
+
+    if (self->_parent)
+    {
+        if (size <= self->len)
+        {
+            self->len = size;
+            return 0;
+        }
+        /* the data belongs to the parent so it needs a copy to grow */
+        data = malloc (size);
+        if (data == NULL)
+            return -1;
+        memcpy (data, self->data, self->len);
+        refbuf_release (self->_parent);
+        self->_parent = NULL;
+    }
+    else if (self->data == NULL || self->data == inline_data)
+    {
+        if (size <= self->_capacity)
+        {
+            self->data = size ? inline_data : NULL;
+            self->len = size;
+            return 0;
+        }
+        data = malloc (size);
+        if (data == NULL)
+            return -1;
+        if (self->data)
+            memcpy (data, self->data, self->len < size ? self->len : size);
+    }
+    else
+    {
+        data = realloc (self->data, size);
+        if (data == NULL)
+            return -1;
+    }
+    self->data = data;
+    self->len = size;
+    return 0;
+}
+
 void refbuf_addref(refbuf_t *self)
 {
+#ifdef HAVE_ATOMIC_BUILTINS
+    __atomic_add_fetch (&self->_count, 1, __ATOMIC_RELAXED);
+#else
+    thread_spin_lock (&refbuf_lock);
     self->_count++;
+    thread_spin_unlock (&refbuf_lock);
+#endif
+}
+
+unsigned int refbuf_count(refbuf_t *self)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+    return __atomic_load_n (&self->_count, __ATOMIC_ACQUIRE);
+#else
+    unsigned int count;
+
+    thread_spin_lock (&refbuf_lock);
+    count = self->_count;
+    thread_spin_unlock (&refbuf_lock);
+    return count;
+#endif
 }
 
 static void refbuf_release_associated (refbuf_t *ref)
@@ -74,7 +431,7 @@ static void refbuf_release_associated (refbuf_t *ref)
     {
         refbuf_t *to_go = ref;
         ref = to_go->next;
-        if ( to_go->_count == 1 )
+        if (refbuf_count (to_go) == 1)
             to_go->next = NULL;
         refbuf_release (to_go);
     }
@@ -82,16 +439,38 @@ static void refbuf_release_associated (refbuf_t *ref)
 
 void refbuf_release(refbuf_t *self)
 {
+    unsigned int count;
+
     if (self == NULL)
         return;
-    self->_count--;
-    if (self->_count == 0)
+#ifdef HAVE_ATOMIC_BUILTINS
+    count = __atomic_sub_fetch (&self->_count, 1, __ATOMIC_RELEASE);
+#else
+    thread_spin_lock (&refbuf_lock);
+    count = --self->_count;
+    thread_spin_unlock (&refbuf_lock);
+#endif
+    if (count == 0)
     {
+        refbuf_cache_t *cache;
+        int class;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+        /* see everything the other holders did before letting go */
+        __atomic_thread_fence (__ATOMIC_ACQUIRE);
+#endif
         refbuf_release_associated (self->associated);
         if (self->next)
             ICECAST_LOG_ERROR("next not null");
-        free(self->data);
-        free(self);
+        if (self->_parent)
+            refbuf_release (self->_parent);
+        else if (self->data && self->data != (char *)(self + 1))
+            free(self->data);
+        class = refbuf_pooled_class (self->_capacity);
+        cache = refbuf_cache_get ();
+        if (cache && class >= 0)
+            refbuf_pool_put (cache, class, self);
+        else
+            free(self);
     }
 }
-
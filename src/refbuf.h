@@ -26,15 +26,23 @@ typedef struct _refbuf_tag
     struct _refbuf_tag *associated;
     struct _refbuf_tag *next;
     int sync_point;
+    unsigned int duration;          /* play time in microseconds, 0 if not known */
+    unsigned int _capacity;
+    struct _refbuf_tag *_parent;    /* data is part of this one */
 
 } refbuf_t;
 
 void refbuf_initialize(void);
 void refbuf_shutdown(void);
+void refbuf_stats(void);
 
 refbuf_t *refbuf_new(unsigned int size);
+refbuf_t *refbuf_new_slice(refbuf_t *parent, unsigned int offset, unsigned int len);
+int refbuf_join_slice(refbuf_t *self, refbuf_t *next);
+int refbuf_resize(refbuf_t *self, unsigned int size);
 void refbuf_addref(refbuf_t *self);
 void refbuf_release(refbuf_t *self);
+unsigned int refbuf_count(refbuf_t *self);
 
 #define PER_CLIENT_REFBUF_SIZE  4096
 
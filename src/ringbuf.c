@@ -0,0 +1,127 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "ringbuf.h"
+#include "logging.h"
+
+#undef CATMODULE
+#define CATMODULE "ringbuf"
+
+/* regions this large are aligned so that they can be backed by huge pages */
+#define RINGBUF_HUGE_PAGE   (2*1024*1024)
+
+struct ringbuf_tag {
+    refbuf_t *region;
+    unsigned int size;
+
+    /* running totals of bytes taken and given back, including the unused
+     * space at the end of the region when a block does not fit there */
+    uint64_t head;
+    uint64_t tail;
+};
+
+
+ringbuf_t *ringbuf_new (unsigned int size)
+{
+    ringbuf_t *ring = calloc (1, sizeof (ringbuf_t));
+    size_t alignment = sizeof (void *);
+    void *data;
+
+    if (ring == NULL)
+        return NULL;
+    if (size >= RINGBUF_HUGE_PAGE)
+    {
+        alignment = RINGBUF_HUGE_PAGE;
+        size = (size + RINGBUF_HUGE_PAGE - 1) & ~(RINGBUF_HUGE_PAGE - 1);
+    }
+    if (posix_memalign (&data, alignment, size) != 0)
+    {
+        ICECAST_LOG_ERROR("unable to allocate %u byte queue ring", size);
+        free (ring);
+        return NULL;
+    }
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_HUGEPAGE)
+    if (alignment == RINGBUF_HUGE_PAGE)
+        madvise (data, size, MADV_HUGEPAGE);
+#endif
+    /* an empty buffer taking over the region, it is freed along with
+     * the buffer once the last block is gone */
+    ring->region = refbuf_new (0);
+    ring->region->data = data;
+    ring->region->len = size;
+    ring->size = size;
+    ICECAST_LOG_DEBUG("created %u byte queue ring", size);
+    return ring;
+}
+
+
+void ringbuf_free (ringbuf_t *ring)
+{
+    if (ring == NULL)
+        return;
+    refbuf_release (ring->region);
+    free (ring);
+}
+
+
+refbuf_t *ringbuf_store (ringbuf_t *ring, refbuf_t *refbuf)
+{
+    unsigned int pos = ring->head % ring->size;
+    uint64_t needed = refbuf->len;
+    refbuf_t *block;
+
+    if (refbuf->len == 0)
+        return NULL;
+    /* blocks are kept contiguous, so skip what is left at the end */
+    if (pos + refbuf->len > ring->size)
+    {
+        needed += ring->size - pos;
+        pos = 0;
+    }
+    if (ring->head - ring->tail + needed > ring->size)
+        return NULL;
+    ring->head += needed;
+
+    block = refbuf_new_slice (ring->region, pos, refbuf->len);
+    memcpy (block->data, refbuf->data, refbuf->len);
+    block->sync_point = refbuf->sync_point;
+    block->duration = refbuf->duration;
+    block->associated = refbuf->associated;
+    refbuf->associated = NULL;
+    return block;
+}
+
+
+void ringbuf_consumed (ringbuf_t *ring, refbuf_t *refbuf)
+{
+    unsigned int end, pos;
+    uint64_t distance;
+
+    if (ring == NULL || refbuf->_parent != ring->region)
+        return;
+    /* blocks leave in the order they came in, so everything up to the
+     * end of this one is free, including any skipped space before it */
+    end = (refbuf->data - ring->region->data) + refbuf->len;
+    pos = ring->tail % ring->size;
+    distance = (end + ring->size - pos) % ring->size;
+    if (distance == 0 && ring->head != ring->tail)
+        distance = ring->size;
+    ring->tail += distance;
+}
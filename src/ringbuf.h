@@ -0,0 +1,37 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* Contiguous storage for the in-flight queue of a source.
+ *
+ * Blocks put on the queue are copied into one large region in the order
+ * they arrive, so that listeners going through the queue read memory
+ * sequentially and neighbouring blocks can go out in a single write.
+ * The blocks are slices of the region, which lives on until the last of
+ * them is released. Space is reused as blocks leave the head of the
+ * queue.
+ */
+
+#ifndef __RINGBUF_H__
+#define __RINGBUF_H__
+
+#include "refbuf.h"
+
+typedef struct ringbuf_tag ringbuf_t;
+
+ringbuf_t *ringbuf_new(unsigned int size);
+void ringbuf_free(ringbuf_t *ring);
+
+/* returns a block in the ring with the contents of refbuf, which the
+ * caller still has to release, or NULL if there is no room for it */
+refbuf_t *ringbuf_store(ringbuf_t *ring, refbuf_t *refbuf);
+
+/* refbuf has left the head of the queue, if it is in the ring the space
+ * up to its end can be reused */
+void ringbuf_consumed(ringbuf_t *ring, refbuf_t *refbuf);
+
+#endif  /* __RINGBUF_H__ */
@@ -755,6 +755,10 @@ static void *_slave_thread(void *arg)
         if (slave_running == 0)
             break;
 
+        refbuf_stats();
+        client_stats();
+        connection_stats();
+
         ++interval;
 
         /* only update relays lists when required */
@@ -58,6 +58,9 @@
 #include "fserve.h"
 #include "auth.h"
 #include "event.h"
+#include "workers.h"
+#include "pollset.h"
+#include "ringbuf.h"
 #include "compat.h"
 
 #undef CATMODULE
@@ -65,13 +68,68 @@
 
 #define MAX_FALLBACK_DEPTH 10
 
+/* extra room in the queue ring, Ogg pages can be almost 64k */
+#define SOURCE_RING_SLACK (128*1024)
+
 mutex_t move_clients_mutex;
 
+/* listener table flags */
+#define LISTENER_STREAMING  0x01    /* following the queue, headers and intro are done */
+#define LISTENER_BLOCKED    0x02    /* watched socket waiting to become writable */
+#define LISTENER_ERROR      0x04    /* to be removed */
+
+/* Dense table of the listeners of a source for the fan-out loop. What is
+ * checked for every listener on every round, the queue position and
+ * flags, is kept in arrays of its own, so that passing over
+ * listeners with nothing to do does not touch their client_t and
+ * connection_t at all. The client tree still holds the listeners for
+ * lookups by id.
+ */
+typedef struct source_listeners_tag
+{
+    unsigned int count;
+    unsigned int allocated;
+    client_t **clients;
+    refbuf_t **refbufs;         /* block in the queue after the last round */
+    unsigned int *pos;          /* and the offset into it */
+    unsigned char *flags;
+    time_t swept;               /* when every listener was last looked at */
+} source_listeners_t;
+
+/* per writer results of a fan-out round */
+typedef struct source_shard_tag
+{
+    uint64_t sent_bytes;
+    int short_delay;
+} source_shard_t;
+
+/* state for serving the listeners from several threads, the listeners
+ * are split into one shard per member of the writers pool */
+typedef struct source_fanout_tag
+{
+    workers_t *writers;
+    unsigned int threads;
+    /* the intro file and header handling is shared, so is serialised */
+    mutex_t lock;
+    /* the round being run */
+    int deletion_expected;
+    time_t now;
+    int sweep;
+    source_shard_t *shards;
+} source_fanout_t;
+
 /* avl tree helper */
 static int _compare_clients(void *compare_arg, void *a, void *b);
 static int _free_client(void *key);
 static void _parse_audio_info (source_t *source, const char *s);
 static void source_shutdown (source_t *source);
+static void source_listener_unwatch (source_t *source, client_t *client);
+static int source_listener_insert (source_t *source, client_t *client);
+static void source_listener_delete (source_t *source, client_t *client, avl_free_key_fun_type free_client);
+static void source_timeout_expired (timerwheel_timer_t *timer, void *arg);
+static int source_push_pending (source_t *source, client_t *client);
+static client_t *source_take_pending (source_t *source);
+static void source_free_pending (source_t *source);
 
 /* Allocate a new source with the stated mountpoint, if one already
  * exists with that mountpoint in the global source tree then return
@@ -98,9 +156,21 @@ source_t *source_reserve (const char *mount)
         src = calloc (1, sizeof(source_t));
         if (src == NULL)
             break;
+        src->listener_table = calloc (1, sizeof(source_listeners_t));
+        src->timers = timerwheel_new (time (NULL));
+        if (src->listener_table == NULL || src->timers == NULL)
+        {
+            free (src->listener_table);
+            timerwheel_free (src->timers);
+            free (src);
+            src = NULL;
+            break;
+        }
+        timerwheel_timer_init (&src->timeout_timer, source_timeout_expired, src);
 
         src->client_tree = avl_tree_new(_compare_clients, NULL);
-        src->pending_tree = avl_tree_new(_compare_clients, NULL);
+        thread_rwlock_create(&src->pending_lock);
+        thread_spin_create(&src->pending_spin);
         src->history = playlist_new(4 /* DOCUMENT: default is max_tracks=4. */);
 
         /* make duplicates for strings or similar */
@@ -204,7 +274,7 @@ void source_clear_source (source_t *source)
 
     ICECAST_LOG_DEBUG("clearing source \"%s\"", source->mount);
 
-    avl_tree_wlock (source->pending_tree);
+    thread_rwlock_wlock (&source->pending_lock);
     client_destroy(source->client);
     source->client = NULL;
     source->parser = NULL;
@@ -223,6 +293,7 @@ void source_clear_source (source_t *source)
 
     /* lets kick off any clients that are left on here */
     avl_tree_wlock (source->client_tree);
+    timerwheel_remove (&source->timeout_timer);
     c=0;
     while (1)
     {
@@ -232,7 +303,7 @@ void source_clear_source (source_t *source)
             client_t *client = node->key;
             if (client->respcode == 200)
                 c++; /* only count clients that have had some processing */
-            avl_delete (source->client_tree, client, _free_client);
+            source_listener_delete (source, client, _free_client);
             continue;
         }
         break;
@@ -242,14 +313,9 @@ void source_clear_source (source_t *source)
         stats_event_sub (NULL, "listeners", source->listeners);
         ICECAST_LOG_INFO("%d active listeners on %s released", c, source->mount);
     }
+    source_free_pending (source);
     avl_tree_unlock (source->client_tree);
 
-    while (avl_get_first (source->pending_tree))
-    {
-        avl_delete (source->pending_tree,
-                avl_get_first(source->pending_tree)->key, _free_client);
-    }
-
     if (source->format && source->format->free_plugin)
         source->format->free_plugin (source->format);
     source->format = NULL;
@@ -261,15 +327,19 @@ void source_clear_source (source_t *source)
         source->stream_data = p->next;
         p->next = NULL;
         /* can be referenced by burst handler as well */
-        while (p->_count > 1)
+        while (refbuf_count (p) > 1)
             refbuf_release (p);
         refbuf_release (p);
     }
     source->stream_data_tail = NULL;
+    ringbuf_free (source->ring);
+    source->ring = NULL;
 
     source->burst_point = NULL;
     source->burst_size = 0;
     source->burst_offset = 0;
+    source->burst_duration = 0;
+    source->burst_time = 0;
     source->queue_size = 0;
     source->queue_size_limit = 0;
     source->listeners = 0;
@@ -297,7 +367,9 @@ void source_clear_source (source_t *source)
     }
 
     source->on_demand_req = 0;
-    avl_tree_unlock (source->pending_tree);
+    pollset_free (source->waitset);
+    source->waitset = NULL;
+    thread_rwlock_unlock (&source->pending_lock);
 }
 
 
@@ -309,8 +381,21 @@ void source_free_source (source_t *source)
     avl_delete (global.source_tree, source, NULL);
     avl_tree_unlock (global.source_tree);
 
-    avl_tree_free(source->pending_tree, _free_client);
+    source_free_pending (source);
+    thread_rwlock_destroy (&source->pending_lock);
+    thread_spin_destroy (&source->pending_spin);
     avl_tree_free(source->client_tree, _free_client);
+    if (source->listener_table)
+    {
+        source_listeners_t *table = source->listener_table;
+
+        free (table->clients);
+        free (table->refbufs);
+        free (table->pos);
+        free (table->flags);
+        free (table);
+    }
+    timerwheel_free (source->timers);
 
     /* make sure all YP entries have gone */
     yp_remove (source->mount);
@@ -361,11 +446,11 @@ void source_move_clients(source_t *source, source_t *dest)
 
     /* if the destination is not running then we can't move clients */
 
-    avl_tree_wlock (dest->pending_tree);
+    thread_rwlock_wlock (&dest->pending_lock);
     if (dest->running == 0 && dest->on_demand == 0)
     {
         ICECAST_LOG_WARN("destination mount %s not running, unable to move clients ", dest->mount);
-        avl_tree_unlock (dest->pending_tree);
+        thread_rwlock_unlock (&dest->pending_lock);
         thread_mutex_unlock (&move_clients_mutex);
         return;
     }
@@ -376,7 +461,7 @@ void source_move_clients(source_t *source, source_t *dest)
 
         /* we need to move the client and pending trees - we must take the
          * locks in this order to avoid deadlocks */
-        avl_tree_wlock(source->pending_tree);
+        thread_rwlock_wlock (&source->pending_lock);
         avl_tree_wlock(source->client_tree);
 
         if (source->on_demand == 0 && source->format == NULL)
@@ -393,13 +478,10 @@ void source_move_clients(source_t *source, source_t *dest)
             }
         }
 
-        while (1)
+        client = source_take_pending (source);
+        while (client)
         {
-            avl_node *node = avl_get_first (source->pending_tree);
-            if (node == NULL)
-                break;
-            client = (client_t *)(node->key);
-            avl_delete (source->pending_tree, client, NULL);
+            client_t *next = client->pending_next;
 
             /* when switching a client to a different queue, be wary of the
              * refbuf it's referring to, if it's http headers then we need
@@ -413,8 +495,9 @@ void source_move_clients(source_t *source, source_t *dest)
                     client->intro_offset = -1;
             }
 
-            avl_insert (dest->pending_tree, (void *)client);
+            source_push_pending (dest, client);
             count++;
+            client = next;
         }
 
         while (1)
@@ -424,7 +507,7 @@ void source_move_clients(source_t *source, source_t *dest)
                 break;
 
             client = (client_t *)(node->key);
-            avl_delete (source->client_tree, client, NULL);
+            source_listener_delete (source, client, NULL);
 
             /* when switching a client to a different queue, be wary of the
              * refbuf it's referring to, if it's http headers then we need
@@ -437,28 +520,216 @@ void source_move_clients(source_t *source, source_t *dest)
                 if (source->con == NULL)
                     client->intro_offset = -1;
             }
-            avl_insert (dest->pending_tree, (void *)client);
+            source_push_pending (dest, client);
             count++;
         }
         ICECAST_LOG_INFO("passing %lu listeners to \"%s\"", count, dest->mount);
+        if (count)
+            source_wakeup (dest);
 
         source->listeners = 0;
         stats_event (source->mount, "listeners", "0");
 
     } while (0);
 
-    avl_tree_unlock (source->pending_tree);
+    thread_rwlock_unlock (&source->pending_lock);
     avl_tree_unlock (source->client_tree);
 
     /* see if we need to wake up an on-demand relay */
     if (dest->running == 0 && dest->on_demand && count)
         dest->on_demand_req = 1;
 
-    avl_tree_unlock (dest->pending_tree);
+    thread_rwlock_unlock (&dest->pending_lock);
     thread_mutex_unlock (&move_clients_mutex);
 }
 
 
+/* Interrupt the wait of the source thread, so that newly added clients
+ * get processed straight away. The caller must hold the pending lock.
+ */
+void source_wakeup (source_t *source)
+{
+    pollset_wakeup (source->waitset);
+}
+
+
+/* Put a listener on the pending list of the source, from any thread.
+ * Listeners are pushed onto the front, so the list is in reverse order.
+ * Returns 1 if the list was empty before.
+ */
+static int source_push_pending (source_t *source, client_t *client)
+{
+    client_t *head;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+    head = __atomic_load_n (&source->pending, __ATOMIC_RELAXED);
+    do
+        client->pending_next = head;
+    while (!__atomic_compare_exchange_n (&source->pending, &head, client, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#else
+    thread_spin_lock (&source->pending_spin);
+    head = source->pending;
+    client->pending_next = head;
+    source->pending = client;
+    thread_spin_unlock (&source->pending_spin);
+#endif
+    return head == NULL;
+}
+
+/* Take every listener off the pending list, in the order they were
+ * added. The client tree must be write locked.
+ */
+static client_t *source_take_pending (source_t *source)
+{
+    client_t *list, *ordered = NULL;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+    /* nothing to swap in the common case */
+    if (__atomic_load_n (&source->pending, __ATOMIC_RELAXED) == NULL)
+        return NULL;
+    list = __atomic_exchange_n (&source->pending, NULL, __ATOMIC_ACQUIRE);
+#else
+    thread_spin_lock (&source->pending_spin);
+    list = source->pending;
+    source->pending = NULL;
+    thread_spin_unlock (&source->pending_spin);
+#endif
+    while (list)
+    {
+        client_t *next = list->pending_next;
+
+        list->pending_next = ordered;
+        ordered = list;
+        list = next;
+    }
+    return ordered;
+}
+
+static void source_free_pending (source_t *source)
+{
+    client_t *client = source_take_pending (source);
+
+    while (client)
+    {
+        client_t *next = client->pending_next;
+
+        _free_client (client);
+        client = next;
+    }
+}
+
+/* Hand a new listener to the source thread. The source thread is only
+ * woken for the first of a batch, the others are picked up with it.
+ */
+void source_add_pending (source_t *source, client_t *client)
+{
+    thread_rwlock_rlock (&source->pending_lock);
+    if (source_push_pending (source, client))
+        source_wakeup (source);
+    thread_rwlock_unlock (&source->pending_lock);
+}
+
+/* The most recently added pending listener, the rest follow through
+ * pending_next. The client tree must be locked, which keeps the source
+ * thread from taking them off while they are looked at.
+ */
+client_t *source_first_pending (source_t *source)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+    return __atomic_load_n (&source->pending, __ATOMIC_ACQUIRE);
+#else
+    client_t *client;
+
+    thread_spin_lock (&source->pending_spin);
+    client = source->pending;
+    thread_spin_unlock (&source->pending_spin);
+    return client;
+#endif
+}
+
+
+/* set up what the source thread waits on, if this is not possible then
+ * the source socket is polled on its own. */
+static void source_waitset_create (source_t *source)
+{
+    pollset_t *waitset;
+
+    if (source->con == NULL)
+        return;
+    waitset = pollset_new ();
+    if (waitset == NULL)
+        return;
+    if (pollset_wakeup_enable (waitset) < 0 ||
+            pollset_add (waitset, source->con->sock, POLLSET_READ, source) < 0)
+    {
+        pollset_free (waitset);
+        return;
+    }
+    thread_rwlock_wlock (&source->pending_lock);
+    source->waitset = waitset;
+    thread_rwlock_unlock (&source->pending_lock);
+}
+
+
+/* wait for the incoming stream to become readable. Returns > 0 if it is,
+ * 0 if the wait timed out or was interrupted by new clients or writable
+ * listeners, < 0 on error.
+ */
+static int source_wait (source_t *source, int delay)
+{
+    pollset_event_t events[8];
+    int count, i, ret = 0;
+
+    if (source->waitset == NULL)
+        return util_timed_wait_for_fd (source->con->sock, delay);
+
+    count = pollset_wait (source->waitset, events, 8, delay);
+    if (count < 0)
+        return -1;
+    for (i = 0; i < count; i++)
+        if (events[i].userdata == source)
+            ret = 1;
+    return ret;
+}
+
+
+/* the source timeout has come round. The wheel is advanced with the
+ * client tree locked, which is taken after the source lock elsewhere, so
+ * it is only noted here and checked once that is dropped */
+static void source_timeout_expired (timerwheel_timer_t *timer, void *arg)
+{
+    source_t *source = arg;
+
+    source->timeout_due = 1;
+}
+
+
+/* the stream is dropped unless something was read since the timeout
+ * was set, in which case it is moved on */
+static void source_timeout_check (source_t *source, time_t current)
+{
+    time_t deadline;
+
+    thread_mutex_lock(&source->lock);
+    deadline = source->last_read + (time_t)source->timeout;
+    if (deadline < current)
+    {
+        ICECAST_LOG_DEBUG("last %ld, timeout %d, now %ld", (long)source->last_read,
+                source->timeout, (long)current);
+        ICECAST_LOG_WARN("Disconnecting source due to socket timeout");
+        source->running = 0;
+    }
+    thread_mutex_unlock(&source->lock);
+    if (deadline >= current)
+    {
+        avl_tree_wlock (source->client_tree);
+        timerwheel_add (source->timers, &source->timeout_timer, deadline + 1);
+        avl_tree_unlock (source->client_tree);
+    }
+}
+
+
 /* get some data from the source. The stream data is placed in a refbuf
  * and sent back, however NULL is also valid as in the case of a short
  * timeout and there's no data pending.
@@ -468,19 +739,47 @@ static refbuf_t *get_next_buffer (source_t *source)
     refbuf_t *refbuf = NULL;
     int delay = 250;
 
+    /* without a waitset we poll the listeners at least 4 times a second,
+     * otherwise we get woken when there is anything to do, and only need
+     * to check for timeouts */
+    if (source->waitset)
+        delay = 1000;
     if (source->short_delay)
         delay = 0;
     while (global.running == ICECAST_RUNNING && source->running)
     {
         int fds = 0;
-        time_t current = time (NULL);
+        time_t current;
 
         if (source->client)
-            fds = util_timed_wait_for_fd (source->con->sock, delay);
+            fds = source_wait (source, delay);
         else
-        {
             thread_sleep (delay*1000);
+
+        /* the clock is read once per pass and kept in the timer wheel
+         * for the rest of the round, which runs the source timeout and
+         * the listener time limits */
+        current = time (NULL);
+        if (source->client == NULL || fds > 0)
             source->last_read = current;
+        if ((uint64_t)current > timerwheel_now (source->timers))
+        {
+            /* only this thread arms timers, so with none armed nothing
+             * else touches the wheel and just its clock moves on */
+            if (timerwheel_count (source->timers))
+            {
+                avl_tree_wlock (source->client_tree);
+                timerwheel_advance (source->timers, current);
+                avl_tree_unlock (source->client_tree);
+            }
+            else
+                timerwheel_advance (source->timers, current);
+        }
+        if (source->timeout_due)
+        {
+            source->timeout_due = 0;
+            if (source->client)
+                source_timeout_check (source, current);
         }
 
         if (current >= source->client_stats_update)
@@ -501,19 +800,7 @@ static refbuf_t *get_next_buffer (source_t *source)
             break;
         }
         if (fds == 0)
-        {
-            thread_mutex_lock(&source->lock);
-            if ((source->last_read + (time_t)source->timeout) < current)
-            {
-                ICECAST_LOG_DEBUG("last %ld, timeout %d, now %ld", (long)source->last_read,
-                        source->timeout, (long)current);
-                ICECAST_LOG_WARN("Disconnecting source due to socket timeout");
-                source->running = 0;
-            }
-            thread_mutex_unlock(&source->lock);
             break;
-        }
-        source->last_read = current;
         refbuf = source->format->get_buffer (source);
         if (source->client->con->tls && tls_got_shutdown(source->client->con->tls) > 1)
             source->client->con->error = 1;
@@ -531,12 +818,32 @@ static refbuf_t *get_next_buffer (source_t *source)
 }
 
 
+/* prepare the next block of data for the client. Queue handling is per
+ * client but anything else may use state shared between listeners, so
+ * needs to be serialised when more than one writer thread is in use.
+ */
+static int source_check_buffer (source_t *source, client_t *client)
+{
+    source_fanout_t *fanout = source->fanout;
+    int ret;
+
+    if (fanout == NULL || client->check_buffer == format_advance_queue)
+        return client->check_buffer (source, client);
+
+    thread_mutex_lock (&fanout->lock);
+    ret = client->check_buffer (source, client);
+    thread_mutex_unlock (&fanout->lock);
+    return ret;
+}
+
+
 /* general send routine per listener.  The deletion_expected tells us whether
  * the last in the queue is about to disappear, so if this client is still
  * referring to it after writing then drop the client as it's fallen too far
- * behind
+ * behind. Returns the number of bytes written, short_delay is set if the
+ * client has more data waiting.
  */
-static void send_to_listener (source_t *source, client_t *client, int deletion_expected)
+static unsigned int send_to_listener (source_t *source, client_t *client, int deletion_expected, time_t now, int *short_delay)
 {
     int bytes;
     int loop = 10;   /* max number of iterations in one go */
@@ -544,14 +851,6 @@ static void send_to_listener (source_t *source, client_t *client, int deletion_e
 
     while (1)
     {
-        /* check for limited listener time */
-        if (client->con->discon_time)
-            if (time(NULL) >= client->con->discon_time)
-            {
-                ICECAST_LOG_INFO("time limit reached for client #%lu", client->con->id);
-                client->con->error = 1;
-            }
-
         /* jump out if client connection has died */
         if (client->con->error)
             break;
@@ -561,13 +860,17 @@ static void send_to_listener (source_t *source, client_t *client, int deletion_e
         if (total_written > 20000 || loop == 0)
         {
             if (client->check_buffer != format_check_file_buffer)
-                source->short_delay = 1;
+                *short_delay = 1;
             break;
         }
 
+        /* wait for the socket to drain before trying again */
+        if (client->con->write_watched && client->con->write_blocked)
+            break;
+
         loop--;
 
-        if (client->check_buffer(source, client) < 0)
+        if (source_check_buffer (source, client) < 0)
             break;
 
         bytes = client->write_to_client(client);
@@ -576,7 +879,6 @@ static void send_to_listener (source_t *source, client_t *client, int deletion_e
 
         total_written += bytes;
     }
-    source->format->sent_bytes += total_written;
 
     /* the refbuf referenced at head (last in queue) may be marked for deletion
      * if so, check to see if this client is still referring to it */
@@ -587,6 +889,328 @@ static void send_to_listener (source_t *source, client_t *client, int deletion_e
         stats_event_inc (source->mount, "slow_listeners");
         client->con->error = 1;
     }
+    return total_written;
+}
+
+
+/* have the socket of a listener watched for writability, edge triggered
+ * so that a listener is only reported again once its send buffer had
+ * filled up. TLS may need to read before it can write so is left out.
+ */
+static void source_listener_watch (source_t *source, client_t *client)
+{
+    connection_t *con = client->con;
+
+    if (source->pollset == NULL || con->tls || con->write_watched)
+        return;
+    con->write_blocked = 0;
+    if (pollset_add (source->pollset, con->sock, POLLSET_WRITE|POLLSET_EDGE, client) == 0)
+        con->write_watched = 1;
+}
+
+static void source_listener_unwatch (source_t *source, client_t *client)
+{
+    connection_t *con = client->con;
+    source_listeners_t *table = source->listener_table;
+
+    if (con->write_watched && source->pollset)
+        pollset_remove (source->pollset, con->sock);
+    con->write_watched = 0;
+    con->write_blocked = 0;
+    if (client->listener_slot < table->count && table->clients[client->listener_slot] == client)
+        table->flags[client->listener_slot] &= ~LISTENER_BLOCKED;
+}
+
+
+/* copy the state of the listener in the given slot into the table */
+static void source_listener_sync (source_listeners_t *table, unsigned int slot)
+{
+    client_t *client = table->clients[slot];
+    connection_t *con = client->con;
+    unsigned char flags = 0;
+
+    if (client->check_buffer == format_advance_queue)
+        flags |= LISTENER_STREAMING;
+    if (con->write_watched && con->write_blocked)
+        flags |= LISTENER_BLOCKED;
+    if (con->error)
+        flags |= LISTENER_ERROR;
+    table->flags[slot] = flags;
+    table->refbufs[slot] = client->refbuf;
+    table->pos[slot] = client->pos;
+}
+
+static int source_listeners_grow (source_listeners_t *table)
+{
+    unsigned int allocated = table->allocated ? table->allocated * 2 : 64;
+    void *ptr;
+
+#define LISTENERS_GROW(field) \
+    ptr = realloc (table->field, allocated * sizeof (*table->field)); \
+    if (ptr == NULL) \
+        return -1; \
+    table->field = ptr;
+
+    LISTENERS_GROW (clients);
+    LISTENERS_GROW (refbufs);
+    LISTENERS_GROW (pos);
+    LISTENERS_GROW (flags);
+#undef LISTENERS_GROW
+    table->allocated = allocated;
+    return 0;
+}
+
+/* a listener has reached its time limit, it is dropped on the sweep of
+ * all listeners which follows every tick of the clock */
+static void source_listener_expired (timerwheel_timer_t *timer, void *arg)
+{
+    client_t *client = arg;
+
+    ICECAST_LOG_INFO("time limit reached for client #%lu", client->con->id);
+    client->con->error = 1;
+}
+
+/* add a listener to the client tree and the listener table, the client
+ * tree must be write locked. Returns -1 if there is no room in the table */
+static int source_listener_insert (source_t *source, client_t *client)
+{
+    source_listeners_t *table = source->listener_table;
+
+    if (table->count == table->allocated && source_listeners_grow (table) < 0)
+        return -1;
+    avl_insert (source->client_tree, client);
+    client->listener_slot = table->count;
+    table->clients[table->count] = client;
+    source_listener_sync (table, table->count);
+    table->count++;
+    source_listener_watch (source, client);
+    if (client->con->discon_time)
+    {
+        timerwheel_timer_init (&client->time_limit, source_listener_expired, client);
+        timerwheel_add (source->timers, &client->time_limit, client->con->discon_time);
+    }
+    return 0;
+}
+
+/* take a listener out of the client tree and the listener table, the last
+ * listener of the table moves into the freed slot */
+static void source_listener_delete (source_t *source, client_t *client, avl_free_key_fun_type free_client)
+{
+    source_listeners_t *table = source->listener_table;
+    unsigned int slot = client->listener_slot;
+
+    source_listener_unwatch (source, client);
+    timerwheel_remove (&client->time_limit);
+    if (slot < table->count && table->clients[slot] == client)
+    {
+        unsigned int last = --table->count;
+
+        if (slot != last)
+        {
+            table->clients[slot] = table->clients[last];
+            table->refbufs[slot] = table->refbufs[last];
+            table->pos[slot] = table->pos[last];
+            table->flags[slot] = table->flags[last];
+            table->clients[slot]->listener_slot = slot;
+        }
+    }
+    avl_delete (source->client_tree, client, free_client);
+}
+
+
+/* check from the table alone whether the listener in the given slot has
+ * nothing to do this round */
+static int source_listener_idle (source_t *source, source_listeners_t *table, unsigned int slot,
+        int deletion_expected, time_t now)
+{
+    unsigned char flags = table->flags[slot];
+    refbuf_t *tail = source->stream_data_tail;
+
+    if (flags & LISTENER_ERROR)
+        return 1;
+    if (deletion_expected && table->refbufs[slot] == source->stream_data)
+        return 0;
+    if (flags & LISTENER_BLOCKED)
+        return 1;
+    /* caught up with the end of the queue */
+    if ((flags & LISTENER_STREAMING) && tail && table->refbufs[slot] == tail && table->pos[slot] == tail->len)
+        return 1;
+    return 0;
+}
+
+/* serve one listener from the table, the client is only looked at if it
+ * has something to do or all are checked on this round */
+static unsigned int source_listener_send (source_t *source, unsigned int slot,
+        int deletion_expected, time_t now, int sweep, int *short_delay)
+{
+    source_listeners_t *table = source->listener_table;
+    unsigned int sent;
+
+    if (sweep == 0 && source_listener_idle (source, table, slot, deletion_expected, now))
+        return 0;
+    sent = send_to_listener (source, table->clients[slot], deletion_expected, now, short_delay);
+    source_listener_sync (table, slot);
+    return sent;
+}
+
+
+/* collect the listeners which have become writable since the last round,
+ * the client tree must be locked */
+static void source_listener_readiness (source_t *source)
+{
+    pollset_event_t events[64];
+    int count;
+
+    if (source->pollset == NULL)
+        return;
+    do
+    {
+        int i;
+
+        count = pollset_wait (source->pollset, events, 64, 0);
+        for (i = 0; i < count; i++)
+        {
+            client_t *client = events[i].userdata;
+            source_listeners_t *table = source->listener_table;
+
+            client->con->write_blocked = 0;
+            if (client->listener_slot < table->count && table->clients[client->listener_slot] == client)
+                table->flags[client->listener_slot] &= ~LISTENER_BLOCKED;
+        }
+    } while (count == 64);
+}
+
+
+/* start or stop watching the listeners when the setting has changed, the
+ * client tree must be write locked. Where it is not supported the setting
+ * is ignored from then on, which only the source thread keeps track of as
+ * source->lock cannot be taken in here */
+static void source_readiness_update (source_t *source, int wanted)
+{
+    avl_node *node;
+
+    if (wanted && source->pollset == NULL && source->readiness_unsupported == 0)
+    {
+        pollset_t *pollset = pollset_new ();
+
+        if (pollset == NULL || pollset_edge_triggered (pollset) == 0)
+        {
+            ICECAST_LOG_WARN("listener readiness not supported on this system, ignored for %s", source->mount);
+            pollset_free (pollset);
+            source->readiness_unsupported = 1;
+            return;
+        }
+        source->pollset = pollset;
+        for (node = avl_get_first (source->client_tree); node; node = avl_get_next (node))
+            source_listener_watch (source, node->key);
+        /* so that the source thread wakes up when listeners become writable */
+        if (source->waitset)
+            pollset_add (source->waitset, pollset_fd (pollset), POLLSET_READ, pollset);
+        ICECAST_LOG_DEBUG("watching listeners on %s for writability", source->mount);
+    }
+    if (wanted == 0 && source->pollset)
+    {
+        for (node = avl_get_first (source->client_tree); node; node = avl_get_next (node))
+            source_listener_unwatch (source, node->key);
+        if (source->waitset)
+            pollset_remove (source->waitset, pollset_fd (source->pollset));
+        pollset_free (source->pollset);
+        source->pollset = NULL;
+    }
+}
+
+
+/* start, resize or stop the writer threads when the setting has changed */
+static void source_fanout_update (source_t *source, unsigned int threads)
+{
+    source_fanout_t *fanout = source->fanout;
+
+    if (threads < 2)
+        threads = 0;
+    if (fanout && fanout->threads == threads)
+        return;
+    if (fanout == NULL && threads == 0)
+        return;
+
+    if (fanout)
+    {
+        workers_free (fanout->writers);
+        thread_mutex_destroy (&fanout->lock);
+        free (fanout->shards);
+        free (fanout);
+        source->fanout = NULL;
+    }
+    if (threads == 0)
+    {
+        ICECAST_LOG_DEBUG("listeners on %s now served by the source thread", source->mount);
+        return;
+    }
+
+    fanout = calloc (1, sizeof (source_fanout_t));
+    if (fanout == NULL)
+        return;
+    fanout->writers = workers_new ("Source Writer", threads);
+    fanout->shards = calloc (threads, sizeof (source_shard_t));
+    if (fanout->writers == NULL || fanout->shards == NULL)
+    {
+        ICECAST_LOG_ERROR("unable to set up writer threads for %s", source->mount);
+        workers_free (fanout->writers);
+        free (fanout->shards);
+        free (fanout);
+        return;
+    }
+    thread_mutex_create (&fanout->lock);
+    fanout->threads = threads;
+    source->fanout = fanout;
+    ICECAST_LOG_INFO("listeners on %s now served by %u threads", source->mount,
+            workers_count (fanout->writers));
+}
+
+
+/* job run by each member of the writers pool, handles one contiguous
+ * range of the listener table */
+static void source_fanout_shard (void *arg, unsigned int member)
+{
+    source_t *source = arg;
+    source_fanout_t *fanout = source->fanout;
+    source_shard_t *shard = &fanout->shards[member];
+    unsigned int members = workers_count (fanout->writers);
+    unsigned int count = source->listener_table->count;
+    unsigned int i = (unsigned int)(((uint64_t)count * member) / members);
+    unsigned int end = (unsigned int)(((uint64_t)count * (member + 1)) / members);
+
+    for (; i < end; i++)
+        shard->sent_bytes += source_listener_send (source, i, fanout->deletion_expected,
+                fanout->now, fanout->sweep, &shard->short_delay);
+}
+
+
+/* send to all listeners using the writer threads. The client tree must be
+ * write locked by the caller for the whole round, any clients found in
+ * error are removed by the caller afterwards.
+ */
+static void source_fanout_run (source_t *source, int deletion_expected, time_t now, int sweep)
+{
+    source_fanout_t *fanout = source->fanout;
+    unsigned int members = workers_count (fanout->writers);
+    unsigned int i;
+
+    if (source->listener_table->count == 0)
+        return;
+
+    fanout->deletion_expected = deletion_expected;
+    fanout->now = now;
+    fanout->sweep = sweep;
+    memset (fanout->shards, 0, members * sizeof (source_shard_t));
+
+    workers_run_all (fanout->writers, source_fanout_shard, source);
+
+    for (i = 0; i < members; i++)
+    {
+        source->format->sent_bytes += fanout->shards[i].sent_bytes;
+        if (fanout->shards[i].short_delay)
+            source->short_delay = 1;
+    }
 }
 
 
@@ -654,6 +1278,17 @@ static void source_init (source_t *source)
         }
     }
 
+    source_waitset_create (source);
+
+    if (source->queue_ring)
+    {
+        /* room for the queue and the blocks going over the limit before
+         * lagging listeners are dropped */
+        source->ring = ringbuf_new (source->queue_size_limit + SOURCE_RING_SLACK);
+        if (source->ring == NULL)
+            ICECAST_LOG_WARN("Cannot create queue ring for %s, using separate buffers", source->mount);
+    }
+
     /* grab a read lock, to make sure we get a chance to cleanup */
     thread_rwlock_rlock (source->shutdown_rwlock);
 
@@ -668,6 +1303,12 @@ static void source_init (source_t *source)
 
     ICECAST_LOG_DEBUG("Source creation complete");
     source->last_read = time (NULL);
+    source->timeout_due = 0;
+    avl_tree_wlock (source->client_tree);
+    timerwheel_advance (source->timers, source->last_read);
+    timerwheel_add (source->timers, &source->timeout_timer,
+            source->last_read + (time_t)source->timeout + 1);
+    avl_tree_unlock (source->client_tree);
     source->prev_listeners = -1;
     source->running = 1;
 
@@ -695,22 +1336,51 @@ static void source_init (source_t *source)
 }
 
 
+/* whether the queue kept for bursts to new listeners holds more than it
+ * should. Measured in play time if that is set up and the stream has it,
+ * else in bytes */
+static int source_burst_full (source_t *source)
+{
+    if (source->burst_duration && source->burst_time)
+        return source->burst_time > (uint64_t)source->burst_duration * 1000;
+    return source->burst_offset > source->burst_size;
+}
+
+
 void source_main (source_t *source)
 {
     refbuf_t *refbuf;
     client_t *client;
-    avl_node *client_node;
+    client_t *pending;
+    source_listeners_t *table = source->listener_table;
 
     source_init (source);
 
     while (global.running == ICECAST_RUNNING && source->running) {
-        int remove_from_q;
+        int remove_from_q, sweep;
+        unsigned int listener_threads, i;
+        int listener_readiness;
+        time_t now;
 
         refbuf = get_next_buffer (source);
 
         remove_from_q = 0;
         source->short_delay = 0;
 
+        if (refbuf && source->ring && refbuf_count (refbuf) == 1 && refbuf->_parent == NULL)
+        {
+            /* move the data into the ring, if full the block is queued as is.
+             * Slices, like Ogg pages, already share the buffer they were
+             * read into and are not worth the copy */
+            refbuf_t *block = ringbuf_store (source->ring, refbuf);
+
+            if (block)
+            {
+                refbuf_release (refbuf);
+                refbuf = block;
+            }
+        }
+
         if (refbuf)
         {
             /* append buffer to the in-flight data queue,  */
@@ -728,7 +1398,8 @@ void source_main (source_t *source)
 
             /* new data on queue, so check the burst point */
             source->burst_offset += refbuf->len;
-            while (source->burst_offset > source->burst_size)
+            source->burst_time += refbuf->duration;
+            while (source_burst_full (source))
             {
                 refbuf_t *to_release = source->burst_point;
 
@@ -736,6 +1407,7 @@ void source_main (source_t *source)
                 {
                     source->burst_point = to_release->next;
                     source->burst_offset -= to_release->len;
+                    source->burst_time -= to_release->duration;
                     refbuf_release(to_release);
                     continue;
                 }
@@ -750,35 +1422,54 @@ void source_main (source_t *source)
         thread_mutex_lock(&source->lock);
         if (source->queue_size > source->queue_size_limit)
             remove_from_q = 1;
+        listener_threads = source->listener_threads;
+        listener_readiness = source->listener_readiness;
         thread_mutex_unlock(&source->lock);
 
-        /* acquire write lock on pending_tree */
-        avl_tree_wlock(source->pending_tree);
+        source_fanout_update (source, listener_threads);
 
         /* acquire write lock on client_tree */
         avl_tree_wlock(source->client_tree);
 
-        client_node = avl_get_first(source->client_tree);
-        while (client_node) {
-            client = (client_t *) client_node->key;
+        source_readiness_update (source, listener_readiness);
+        source_listener_readiness (source);
 
-            send_to_listener(source, client, remove_from_q);
+        /* once a second every listener is looked at, to catch any
+         * changes made to it from elsewhere, like an admin kill */
+        now = (time_t)timerwheel_now (source->timers);
+        sweep = now != table->swept;
+        table->swept = now;
 
-            if (client->con->error) {
-                client_node = avl_get_next(client_node);
-                if (client->respcode == 200)
-                    stats_event_dec(NULL, "listeners");
-                avl_delete(source->client_tree, (void *) client, _free_client);
-                source->listeners--;
-                ICECAST_LOG_DEBUG("Client removed");
+        if (source->fanout)
+            source_fanout_run (source, remove_from_q, now, sweep);
+        else
+        {
+            for (i = 0; i < table->count; i++)
+                source->format->sent_bytes += source_listener_send (source, i,
+                        remove_from_q, now, sweep, &source->short_delay);
+        }
+
+        i = 0;
+        while (i < table->count) {
+            if ((table->flags[i] & LISTENER_ERROR) == 0) {
+                i++;
                 continue;
             }
-            client_node = avl_get_next(client_node);
+            /* the last listener takes this slot, so look at it again */
+            client = table->clients[i];
+            if (client->respcode == 200)
+                stats_event_dec(NULL, "listeners");
+            source_listener_delete (source, client, _free_client);
+            source->listeners--;
+            ICECAST_LOG_DEBUG("Client removed");
         }
 
         /** add pending clients **/
-        client_node = avl_get_first(source->pending_tree);
-        while (client_node) {
+        pending = source_take_pending (source);
+        while (pending) {
+            client = pending;
+            pending = client->pending_next;
+            client->pending_next = NULL;
 
             if(source->max_listeners != -1 &&
                     source->listeners >= (unsigned long)source->max_listeners)
@@ -788,9 +1479,7 @@ void source_main (source_t *source)
                  * and doesn't give the listening client any information about
                  * why they were disconnected
                  */
-                client = (client_t *)client_node->key;
-                client_node = avl_get_next(client_node);
-                avl_delete(source->pending_tree, (void *)client, _free_client);
+                _free_client (client);
 
                 ICECAST_LOG_INFO("Client deleted, exceeding maximum listeners for this "
                         "mountpoint (%s).", source->mount);
@@ -798,25 +1487,18 @@ void source_main (source_t *source)
             }
 
             /* Otherwise, the client is accepted, add it */
-            avl_insert(source->client_tree, client_node->key);
+            if (source_listener_insert (source, client) < 0)
+            {
+                ICECAST_LOG_ERROR("No memory for another listener on %s", source->mount);
+                _free_client (client);
+                continue;
+            }
 
             source->listeners++;
             ICECAST_LOG_DEBUG("Client added for mountpoint (%s)", source->mount);
             stats_event_inc(source->mount, "connections");
-
-            client_node = avl_get_next(client_node);
-        }
-
-        /** clear pending tree **/
-        while (avl_get_first(source->pending_tree)) {
-            avl_delete(source->pending_tree,
-                    avl_get_first(source->pending_tree)->key,
-                    source_remove_client);
         }
 
-        /* release write lock on pending_tree */
-        avl_tree_unlock(source->pending_tree);
-
         /* update the stats if need be */
         if (source->listeners != source->prev_listeners)
         {
@@ -840,7 +1522,7 @@ void source_main (source_t *source)
             /* normal unreferenced queue data will have a refcount 1, but
              * burst queue data will be at least 2, active clients will also
              * increase refcount */
-            while (source->stream_data->_count == 1)
+            while (refbuf_count (source->stream_data) == 1)
             {
                 refbuf_t *to_go = source->stream_data;
 
@@ -854,6 +1536,7 @@ void source_main (source_t *source)
                 source->stream_data = to_go->next;
                 source->queue_size -= to_go->len;
                 to_go->next = NULL;
+                ringbuf_consumed (source->ring, to_go);
                 refbuf_release (to_go);
             }
         }
@@ -868,6 +1551,7 @@ void source_main (source_t *source)
 static void source_shutdown (source_t *source)
 {
     source->running = 0;
+    source_fanout_update (source, 0);
     if (source->con && source->con->ip) {
         ICECAST_LOG_INFO("Source from %s at \"%s\" exiting", source->con->ip, source->mount);
     } else {
@@ -923,6 +1607,9 @@ static void source_shutdown (source_t *source)
     /* we don't remove the source from the tree here, it may be a relay and
      therefore reserved */
     source_clear_source(source);
+    pollset_free (source->pollset);
+    source->pollset = NULL;
+    source->readiness_unsupported = 0;
 
     global_lock();
     global.sources--;
@@ -1225,6 +1912,19 @@ static void source_apply_mount (ice_config_t *config, source_t *source, mount_pr
     if (mountinfo && mountinfo->burst_size >= 0)
         source->burst_size = (unsigned int) mountinfo->burst_size;
 
+    source->burst_duration = 0;
+    if (mountinfo && mountinfo->burst_duration)
+        source->burst_duration = mountinfo->burst_duration;
+
+    if (mountinfo && mountinfo->listener_threads)
+        source->listener_threads = mountinfo->listener_threads;
+
+    if (mountinfo && mountinfo->listener_readiness)
+        source->listener_readiness = mountinfo->listener_readiness;
+
+    if (mountinfo && mountinfo->queue_ring)
+        source->queue_ring = mountinfo->queue_ring;
+
     if (mountinfo && mountinfo->fallback_when_full)
         source->fallback_when_full = mountinfo->fallback_when_full;
 
@@ -1253,6 +1953,9 @@ void source_update_settings (ice_config_t *config, source_t *source, mount_proxy
     source->queue_size_limit = config->queue_size_limit;
     source->timeout = config->source_timeout;
     source->burst_size = config->burst_size;
+    source->listener_threads = 0;
+    source->listener_readiness = 0;
+    source->queue_ring = 0;
 
     stats_event_args (source->mount, "listenurl", "http://%s:%d%s",
             config->hostname, config->port, source->mount);
@@ -1294,6 +1997,9 @@ void source_update_settings (ice_config_t *config, source_t *source, mount_proxy
     ICECAST_LOG_DEBUG("max listeners to %ld", source->max_listeners);
     ICECAST_LOG_DEBUG("queue size to %u", source->queue_size_limit);
     ICECAST_LOG_DEBUG("burst size to %u", source->burst_size);
+    ICECAST_LOG_DEBUG("burst duration to %u ms", source->burst_duration);
+    ICECAST_LOG_DEBUG("listener threads to %u", source->listener_threads);
+    ICECAST_LOG_DEBUG("queue ring %s", source->queue_ring ? "enabled" : "disabled");
     ICECAST_LOG_DEBUG("source timeout to %u", source->timeout);
     ICECAST_LOG_DEBUG("fallback_when_full to %u", source->fallback_when_full);
     thread_mutex_unlock(&source->lock);
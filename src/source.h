@@ -19,6 +19,7 @@
 #include "util.h"
 #include "format.h"
 #include "playlist.h"
+#include "timerwheel.h"
 #include "common/thread/thread.h"
 
 #include <stdio.h>
@@ -43,7 +44,16 @@ typedef struct source_tag
     struct _format_plugin_tag *format;
 
     avl_tree *client_tree;
-    avl_tree *pending_tree;
+
+    /* new listeners for the source thread to take on, pushed without a
+     * lock and only taken off with the client tree write locked */
+    client_t *pending;
+    /* guards pending where there are no atomic builtins, it is taken with
+     * the client tree locked so source->lock cannot be used */
+    spin_t pending_spin;
+    /* held for reading while handing over listeners, for writing while
+     * the source is set up or cleared */
+    rwlock_t pending_lock;
 
     rwlock_t *shutdown_rwlock;
     util_dict *audio_info;
@@ -65,12 +75,42 @@ typedef struct source_tag
     /* per source burst handling for connecting clients */
     unsigned int burst_size;    /* trigger level for burst on connect */
     unsigned int burst_offset; 
+    unsigned int burst_duration; /* in ms, used instead of the size if set */
+    uint64_t burst_time;        /* play time of the burst in microseconds */
     refbuf_t *burst_point;
 
     unsigned int queue_size;
     unsigned int queue_size_limit;
 
+    /* queue data kept in a ring instead of separate buffers, the setting
+     * is picked up when the source starts */
+    int queue_ring;
+    struct ringbuf_tag *ring;
+
+    /* listeners in a dense table for the fan-out loop */
+    struct source_listeners_tag *listener_table;
+
+    /* listener fan-out split over several writer threads */
+    unsigned int listener_threads;
+    struct source_fanout_tag *fanout;
+
+    /* listener sockets watched for writability */
+    int listener_readiness;
+    int readiness_unsupported;  /* source thread only */
+    struct pollset_tag *pollset;
+
+    /* what the source thread waits on, the incoming stream, the listener
+     * pollset and wakeups for new clients */
+    struct pollset_tag *waitset;
+
     unsigned timeout;  /* source timeout in seconds */
+    /* source timeout and listener time limits, its time is the clock of
+     * the source thread. Listeners are moved off from other threads, so
+     * while any timer is armed it is only changed with the client tree
+     * write locked */
+    timerwheel_t *timers;
+    timerwheel_timer_t timeout_timer;
+    int timeout_due;            /* source thread only */
     int on_demand;
     int on_demand_req;
     int hidden;
@@ -95,6 +135,9 @@ client_t *source_find_client(source_t *source, int id);
 int source_compare_sources(void *arg, void *a, void *b);
 void source_free_source(source_t *source);
 void source_move_clients (source_t *source, source_t *dest);
+void source_wakeup (source_t *source);
+void source_add_pending (source_t *source, client_t *client);
+client_t *source_first_pending (source_t *source);
 int source_remove_client(void *key);
 void source_main(source_t *source);
 void source_recheck_mounts (int update_all);
@@ -0,0 +1,212 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "timerwheel.h"
+
+#define WHEEL_BITS      6
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    4
+/* the furthest ahead a timer can be placed, later ones are placed there
+ * and moved on again when they come round */
+#define WHEEL_RANGE     ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+#define SLOT_INDEX(t,level)     (((t) >> ((level) * WHEEL_BITS)) & WHEEL_MASK)
+
+struct timerwheel_tag {
+    uint64_t now;
+    unsigned long count;
+    timerwheel_timer_t *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+
+static void wheel_link (timerwheel_timer_t **head, timerwheel_timer_t *timer)
+{
+    timer->next = *head;
+    if (timer->next)
+        timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void wheel_unlink (timerwheel_timer_t *timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next)
+        timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* put an unlinked timer into the slot matching its expiry, or the one
+ * of the earliest time given if that is later */
+static void wheel_place (timerwheel_t *wheel, timerwheel_timer_t *timer, uint64_t earliest)
+{
+    uint64_t when = timer->expires;
+    uint64_t delta;
+    int level;
+
+    if (when < earliest)
+        when = earliest;
+    delta = when - wheel->now;
+    if (delta >= WHEEL_RANGE)
+    {
+        when = wheel->now + WHEEL_RANGE - 1;
+        delta = WHEEL_RANGE - 1;
+    }
+    for (level = 0; level < WHEEL_LEVELS - 1; level++)
+        if (delta < ((uint64_t)1 << ((level + 1) * WHEEL_BITS)))
+            break;
+    wheel_link (&wheel->slots[level][SLOT_INDEX(when, level)], timer);
+}
+
+/* move the timers of the current slot of a higher level down */
+static void wheel_cascade (timerwheel_t *wheel, int level)
+{
+    unsigned int index = SLOT_INDEX(wheel->now, level);
+    timerwheel_timer_t *list = wheel->slots[level][index];
+
+    wheel->slots[level][index] = NULL;
+    while (list)
+    {
+        timerwheel_timer_t *timer = list;
+
+        list = timer->next;
+        timer->next = NULL;
+        timer->pprev = NULL;
+        /* those due now go on the slot about to be run */
+        wheel_place (wheel, timer, wheel->now);
+    }
+}
+
+
+timerwheel_t *timerwheel_new (uint64_t now)
+{
+    timerwheel_t *wheel = calloc (1, sizeof (timerwheel_t));
+
+    if (wheel)
+        wheel->now = now;
+    return wheel;
+}
+
+void timerwheel_free (timerwheel_t *wheel)
+{
+    int level, index;
+
+    if (wheel == NULL)
+        return;
+    for (level = 0; level < WHEEL_LEVELS; level++)
+        for (index = 0; index < WHEEL_SLOTS; index++)
+            while (wheel->slots[level][index])
+            {
+                timerwheel_timer_t *timer = wheel->slots[level][index];
+
+                wheel_unlink (timer);
+                timer->wheel = NULL;
+            }
+    free (wheel);
+}
+
+
+void timerwheel_timer_init (timerwheel_timer_t *timer, timerwheel_expired_t expired, void *arg)
+{
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->wheel = NULL;
+    timer->expires = 0;
+    timer->expired = expired;
+    timer->arg = arg;
+}
+
+void timerwheel_add (timerwheel_t *wheel, timerwheel_timer_t *timer, uint64_t expires)
+{
+    timerwheel_remove (timer);
+    timer->wheel = wheel;
+    timer->expires = expires;
+    wheel_place (wheel, timer, wheel->now + 1);
+    wheel->count++;
+}
+
+void timerwheel_remove (timerwheel_timer_t *timer)
+{
+    if (timer->pprev == NULL)
+        return;
+    wheel_unlink (timer);
+    timer->wheel->count--;
+    timer->wheel = NULL;
+}
+
+
+unsigned int timerwheel_advance (timerwheel_t *wheel, uint64_t now)
+{
+    unsigned int expired = 0;
+
+    while (wheel->now < now)
+    {
+        timerwheel_timer_t *list;
+        int level;
+
+        /* nothing armed, so there is nothing to step through */
+        if (wheel->count == 0)
+        {
+            wheel->now = now;
+            break;
+        }
+        wheel->now++;
+
+        /* when a level wraps round, bring the next slot of the level
+         * above down */
+        for (level = 1; level < WHEEL_LEVELS; level++)
+        {
+            if (SLOT_INDEX(wheel->now, level - 1) != 0)
+                break;
+            wheel_cascade (wheel, level);
+        }
+
+        /* detach the due slot, the callbacks may re-arm or remove
+         * anything, including timers still on this list */
+        list = wheel->slots[0][SLOT_INDEX(wheel->now, 0)];
+        wheel->slots[0][SLOT_INDEX(wheel->now, 0)] = NULL;
+        if (list)
+            list->pprev = &list;
+        while (list)
+        {
+            timerwheel_timer_t *timer = list;
+
+            wheel_unlink (timer);
+            if (timer->expires > wheel->now)
+            {
+                /* placed early as it was too far ahead */
+                wheel_place (wheel, timer, wheel->now + 1);
+                continue;
+            }
+            wheel->count--;
+            timer->wheel = NULL;
+            expired++;
+            timer->expired (timer, timer->arg);
+        }
+    }
+    return expired;
+}
+
+uint64_t timerwheel_now (const timerwheel_t *wheel)
+{
+    return wheel->now;
+}
+
+unsigned long timerwheel_count (const timerwheel_t *wheel)
+{
+    return wheel->count;
+}
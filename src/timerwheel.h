@@ -0,0 +1,60 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* Hierarchical timer wheel for deadlines in whole seconds.
+ *
+ * Timers are embedded in the structure they belong to and are linked
+ * into one of 64 slots on each of 4 levels, so arming and cancelling a
+ * timer is O(1) and advancing the wheel only looks at the timers which
+ * are due, moving the ones of a higher level down when its slot comes
+ * round. The time given to the last advance is kept as a coarse clock
+ * for the owner to use instead of reading the time again.
+ *
+ * A wheel is not locked, it belongs to one thread or is protected by
+ * a lock of its owner.
+ */
+
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#include <stdint.h>
+
+typedef struct timerwheel_tag timerwheel_t;
+typedef struct timerwheel_timer_tag timerwheel_timer_t;
+
+typedef void (*timerwheel_expired_t)(timerwheel_timer_t *timer, void *arg);
+
+struct timerwheel_timer_tag {
+    timerwheel_timer_t *next;
+    timerwheel_timer_t **pprev;     /* NULL when not armed */
+    timerwheel_t *wheel;
+    uint64_t expires;
+    timerwheel_expired_t expired;
+    void *arg;
+};
+
+timerwheel_t *timerwheel_new(uint64_t now);
+/* any timers still armed are disarmed, without calling them */
+void          timerwheel_free(timerwheel_t *wheel);
+
+void          timerwheel_timer_init(timerwheel_timer_t *timer, timerwheel_expired_t expired, void *arg);
+/* arm the timer to expire at the given time, re-arming it if already
+ * armed, times not after the current one expire on the next advance */
+void          timerwheel_add(timerwheel_t *wheel, timerwheel_timer_t *timer, uint64_t expires);
+/* disarm the timer, nothing happens if it is not armed */
+void          timerwheel_remove(timerwheel_timer_t *timer);
+#define       timerwheel_armed(timer)    ((timer)->pprev != NULL)
+
+/* move the wheel on to the given time, calling the expired timers which
+ * may re-arm or remove any timers. Going back in time is ignored.
+ * Returns the number of timers which expired */
+unsigned int  timerwheel_advance(timerwheel_t *wheel, uint64_t now);
+uint64_t      timerwheel_now(const timerwheel_t *wheel);
+unsigned long timerwheel_count(const timerwheel_t *wheel);
+
+#endif  /* __TIMERWHEEL_H__ */
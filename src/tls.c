@@ -22,6 +22,11 @@
 #include "logging.h"
 #define CATMODULE "tls"
 
+/* sessions kept for resumption by clients without tickets */
+#define TLS_SESSION_CACHE_SIZE  20480
+/* seconds a session, cached or in a ticket, can be resumed */
+#define TLS_SESSION_TIMEOUT     7200
+
 /* Check for a specific implementation. Returns 0 if supported, 1 if unsupported and -1 on error. */
 int        tls_check_impl(const char *impl)
 {
@@ -83,6 +88,16 @@ tls_ctx_t *tls_ctx_new(const char *cert_file, const char *key_file, const char *
     SSL_CTX_set_options(ctx->ctx, ssl_opts|SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
 #endif
 
+    /* returning players skip the key exchange, by a ticket they kept or
+     * by the session cached here */
+    SSL_CTX_set_session_id_context(ctx->ctx, (const unsigned char *)"icecast", 7);
+    SSL_CTX_set_session_cache_mode(ctx->ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx->ctx, TLS_SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx->ctx, TLS_SESSION_TIMEOUT);
+#ifdef SSL_OP_NO_TICKET
+    SSL_CTX_clear_options(ctx->ctx, SSL_OP_NO_TICKET);
+#endif
+
     do {
         if (SSL_CTX_use_certificate_chain_file(ctx->ctx, cert_file) <= 0) {
             ICECAST_LOG_WARN("Invalid cert file %s", cert_file);
@@ -133,6 +148,24 @@ void       tls_ctx_unref(tls_ctx_t *ctx)
     free(ctx);
 }
 
+void       tls_ctx_keep_sessions(tls_ctx_t *ctx, tls_ctx_t *old)
+{
+#ifdef SSL_CTRL_GET_TLSEXT_TICKET_KEYS
+    unsigned char keys[128];
+    long len;
+
+    if (!ctx || !old)
+        return;
+
+    /* the size of the keys differs between OpenSSL versions */
+    len = SSL_CTX_get_tlsext_ticket_keys(old->ctx, NULL, 0);
+    if (len <= 0 || len > (long)sizeof(keys))
+        return;
+    if (SSL_CTX_get_tlsext_ticket_keys(old->ctx, keys, len) > 0)
+        SSL_CTX_set_tlsext_ticket_keys(ctx->ctx, keys, len);
+#endif
+}
+
 tls_t     *tls_new(tls_ctx_t *ctx)
 {
     tls_t *tls;
@@ -221,6 +254,53 @@ int        tls_want_io(tls_t *tls)
     }
 }
 
+int        tls_want_write(tls_t *tls)
+{
+    if (!tls)
+        return -1;
+
+    return SSL_want_write(tls->ssl) ? 1 : 0;
+}
+
+int        tls_handshake(tls_t *tls)
+{
+    int ret;
+
+    if (!tls)
+        return -1;
+
+    ERR_clear_error();
+    ret = SSL_do_handshake(tls->ssl);
+    if (ret == 1)
+        return 1;
+
+    switch (SSL_get_error(tls->ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            return 0;
+        break;
+        default:
+            return -1;
+        break;
+    }
+}
+
+int        tls_handshake_done(tls_t *tls)
+{
+    if (!tls)
+        return -1;
+
+    return SSL_is_init_finished(tls->ssl) ? 1 : 0;
+}
+
+int        tls_session_reused(tls_t *tls)
+{
+    if (!tls)
+        return -1;
+
+    return SSL_session_reused(tls->ssl) ? 1 : 0;
+}
+
 int        tls_got_shutdown(tls_t *tls)
 {
     if (!tls)
@@ -265,6 +345,9 @@ void       tls_ctx_ref(tls_ctx_t *ctx)
 void       tls_ctx_unref(tls_ctx_t *ctx)
 {
 }
+void       tls_ctx_keep_sessions(tls_ctx_t *ctx, tls_ctx_t *old)
+{
+}
 
 tls_t     *tls_new(tls_ctx_t *ctx)
 {
@@ -288,6 +371,23 @@ int        tls_want_io(tls_t *tls)
 {
     return -1;
 }
+int        tls_want_write(tls_t *tls)
+{
+    return -1;
+}
+
+int        tls_handshake(tls_t *tls)
+{
+    return -1;
+}
+int        tls_handshake_done(tls_t *tls)
+{
+    return -1;
+}
+int        tls_session_reused(tls_t *tls)
+{
+    return -1;
+}
 
 int        tls_got_shutdown(tls_t *tls)
 {
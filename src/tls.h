@@ -34,6 +34,9 @@ void       tls_shutdown(void);
 tls_ctx_t *tls_ctx_new(const char *cert_file, const char *key_file, const char *cipher_list);
 void       tls_ctx_ref(tls_ctx_t *ctx);
 void       tls_ctx_unref(tls_ctx_t *ctx);
+/* Carry the session ticket keys of old over to ctx so that clients can
+ * still resume their sessions after the context was recreated. */
+void       tls_ctx_keep_sessions(tls_ctx_t *ctx, tls_ctx_t *old);
 
 tls_t     *tls_new(tls_ctx_t *ctx);
 void       tls_ref(tls_t *tls);
@@ -43,6 +46,14 @@ void       tls_set_incoming(tls_t *tls);
 void       tls_set_socket(tls_t *tls, sock_t sock);
 
 int        tls_want_io(tls_t *tls);
+int        tls_want_write(tls_t *tls);
+
+/* Drive the handshake on a non-blocking socket. Returns 1 once done, 0 if
+ * it has to wait for the socket (see tls_want_write()) and -1 on error. */
+int        tls_handshake(tls_t *tls);
+int        tls_handshake_done(tls_t *tls);
+/* Returns 1 if the handshake resumed an earlier session. */
+int        tls_session_reused(tls_t *tls);
 
 int        tls_got_shutdown(tls_t *tls);
 
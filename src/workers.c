@@ -0,0 +1,350 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#include "common/thread/thread.h"
+
+#include "workers.h"
+#include "logging.h"
+
+#undef CATMODULE
+#define CATMODULE "workers"
+
+typedef struct workers_member_tag {
+    workers_t *workers;
+    unsigned int id;
+    thread_type *thread;
+} workers_member_t;
+
+struct workers_tag {
+    /* the cond_t of the thread library can lose wakeups, as we depend on
+     * every round being seen by every member we use the pthread ones here.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      /* new round or shutdown */
+    pthread_cond_t done;        /* last member of a round has finished */
+
+    unsigned int count;
+    workers_member_t *members;
+
+    int running;
+    unsigned long round;
+    unsigned int outstanding;
+    workers_job_t job;
+    void *arg;
+};
+
+
+static void *workers_thread (void *arg)
+{
+    workers_member_t *member = arg;
+    workers_t *workers = member->workers;
+    unsigned long round = 0; /* rounds may start before we get here */
+
+    pthread_mutex_lock (&workers->lock);
+    while (1)
+    {
+        workers_job_t job;
+        void *job_arg;
+
+        while (workers->running && workers->round == round)
+            pthread_cond_wait (&workers->wakeup, &workers->lock);
+        if (workers->running == 0)
+            break;
+        round = workers->round;
+        job = workers->job;
+        job_arg = workers->arg;
+        pthread_mutex_unlock (&workers->lock);
+
+        job (job_arg, member->id);
+
+        pthread_mutex_lock (&workers->lock);
+        workers->outstanding--;
+        if (workers->outstanding == 0)
+            pthread_cond_signal (&workers->done);
+    }
+    pthread_mutex_unlock (&workers->lock);
+    return NULL;
+}
+
+
+workers_t *workers_new (const char *name, unsigned int count)
+{
+    workers_t *workers;
+    unsigned int i;
+
+    if (count == 0)
+        return NULL;
+    workers = calloc (1, sizeof (workers_t));
+    if (workers == NULL)
+        return NULL;
+    workers->members = calloc (count, sizeof (workers_member_t));
+    if (workers->members == NULL)
+    {
+        free (workers);
+        return NULL;
+    }
+    pthread_mutex_init (&workers->lock, NULL);
+    pthread_cond_init (&workers->wakeup, NULL);
+    pthread_cond_init (&workers->done, NULL);
+    workers->count = count;
+    workers->running = 1;
+
+    /* member 0 is whoever calls workers_run_all */
+    for (i = 1; i < count; i++)
+    {
+        workers_member_t *member = &workers->members[i];
+
+        member->workers = workers;
+        member->id = i;
+        member->thread = thread_create ((char *)name, workers_thread, member, THREAD_ATTACHED);
+        if (member->thread == NULL)
+        {
+            ICECAST_LOG_ERROR("unable to start worker thread %u of \"%s\"", i, name);
+            workers->count = i;
+            break;
+        }
+    }
+    ICECAST_LOG_DEBUG("started %u worker threads for \"%s\"", workers->count - 1, name);
+    return workers;
+}
+
+
+void workers_free (workers_t *workers)
+{
+    unsigned int i;
+
+    if (workers == NULL)
+        return;
+    pthread_mutex_lock (&workers->lock);
+    workers->running = 0;
+    pthread_cond_broadcast (&workers->wakeup);
+    pthread_mutex_unlock (&workers->lock);
+
+    for (i = 1; i < workers->count; i++)
+        thread_join (workers->members[i].thread);
+
+    pthread_cond_destroy (&workers->done);
+    pthread_cond_destroy (&workers->wakeup);
+    pthread_mutex_destroy (&workers->lock);
+    free (workers->members);
+    free (workers);
+}
+
+
+unsigned int workers_count (workers_t *workers)
+{
+    if (workers == NULL)
+        return 1;
+    return workers->count;
+}
+
+
+void workers_run_all (workers_t *workers, workers_job_t job, void *arg)
+{
+    if (workers == NULL || workers->count < 2)
+    {
+        job (arg, 0);
+        return;
+    }
+    pthread_mutex_lock (&workers->lock);
+    workers->job = job;
+    workers->arg = arg;
+    workers->outstanding = workers->count - 1;
+    workers->round++;
+    pthread_cond_broadcast (&workers->wakeup);
+    pthread_mutex_unlock (&workers->lock);
+
+    job (arg, 0);
+
+    pthread_mutex_lock (&workers->lock);
+    while (workers->outstanding)
+        pthread_cond_wait (&workers->done, &workers->lock);
+    pthread_mutex_unlock (&workers->lock);
+}
+
+
+typedef struct workqueue_entry_tag {
+    workqueue_job_t job;
+    void *arg;
+    struct timeval queued;
+    struct workqueue_entry_tag *next;
+} workqueue_entry_t;
+
+struct workqueue_tag {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;      /* job added or shutdown */
+
+    unsigned int count;
+    thread_type **threads;
+
+    int running;
+    unsigned int limit;
+    unsigned int depth;
+    workqueue_entry_t *head, **tail;
+
+    /* waiting times of the jobs started since the stats were last taken */
+    unsigned long started;
+    unsigned long long wait_total;
+    unsigned long wait_max;
+};
+
+
+static void *workqueue_thread (void *arg)
+{
+    workqueue_t *queue = arg;
+
+    pthread_mutex_lock (&queue->lock);
+    while (1)
+    {
+        workqueue_entry_t *entry;
+        struct timeval now;
+        unsigned long waited;
+
+        while (queue->running && queue->head == NULL)
+            pthread_cond_wait (&queue->wakeup, &queue->lock);
+        entry = queue->head;
+        if (entry == NULL)
+            break;
+        queue->head = entry->next;
+        if (queue->head == NULL)
+            queue->tail = &queue->head;
+        queue->depth--;
+
+        gettimeofday (&now, NULL);
+        waited = (now.tv_sec - entry->queued.tv_sec) * 1000000L + (now.tv_usec - entry->queued.tv_usec);
+        if ((long)waited < 0)
+            waited = 0;
+        queue->started++;
+        queue->wait_total += waited;
+        if (waited > queue->wait_max)
+            queue->wait_max = waited;
+        pthread_mutex_unlock (&queue->lock);
+
+        entry->job (entry->arg);
+        free (entry);
+
+        pthread_mutex_lock (&queue->lock);
+    }
+    pthread_mutex_unlock (&queue->lock);
+    return NULL;
+}
+
+
+workqueue_t *workqueue_new (const char *name, unsigned int threads, unsigned int limit)
+{
+    workqueue_t *queue;
+    unsigned int i;
+
+    if (threads == 0)
+        return NULL;
+    queue = calloc (1, sizeof (workqueue_t));
+    if (queue == NULL)
+        return NULL;
+    queue->threads = calloc (threads, sizeof (thread_type *));
+    if (queue->threads == NULL)
+    {
+        free (queue);
+        return NULL;
+    }
+    pthread_mutex_init (&queue->lock, NULL);
+    pthread_cond_init (&queue->wakeup, NULL);
+    queue->running = 1;
+    queue->limit = limit;
+    queue->tail = &queue->head;
+
+    for (i = 0; i < threads; i++)
+    {
+        queue->threads[i] = thread_create ((char *)name, workqueue_thread, queue, THREAD_ATTACHED);
+        if (queue->threads[i] == NULL)
+        {
+            ICECAST_LOG_ERROR("unable to start worker thread %u of \"%s\"", i, name);
+            break;
+        }
+    }
+    queue->count = i;
+    if (queue->count == 0)
+    {
+        workqueue_free (queue);
+        return NULL;
+    }
+    ICECAST_LOG_DEBUG("started %u worker threads for \"%s\"", queue->count, name);
+    return queue;
+}
+
+
+void workqueue_free (workqueue_t *queue)
+{
+    unsigned int i;
+
+    if (queue == NULL)
+        return;
+    pthread_mutex_lock (&queue->lock);
+    queue->running = 0;
+    pthread_cond_broadcast (&queue->wakeup);
+    pthread_mutex_unlock (&queue->lock);
+
+    for (i = 0; i < queue->count; i++)
+        thread_join (queue->threads[i]);
+
+    pthread_cond_destroy (&queue->wakeup);
+    pthread_mutex_destroy (&queue->lock);
+    free (queue->threads);
+    free (queue);
+}
+
+
+int workqueue_add (workqueue_t *queue, workqueue_job_t job, void *arg)
+{
+    workqueue_entry_t *entry = malloc (sizeof (workqueue_entry_t));
+
+    if (entry == NULL)
+        return -1;
+    entry->job = job;
+    entry->arg = arg;
+    entry->next = NULL;
+    gettimeofday (&entry->queued, NULL);
+
+    pthread_mutex_lock (&queue->lock);
+    if (queue->running == 0 || (queue->limit && queue->depth >= queue->limit))
+    {
+        pthread_mutex_unlock (&queue->lock);
+        free (entry);
+        return -1;
+    }
+    *queue->tail = entry;
+    queue->tail = &entry->next;
+    queue->depth++;
+    pthread_cond_signal (&queue->wakeup);
+    pthread_mutex_unlock (&queue->lock);
+    return 0;
+}
+
+
+void workqueue_get_stats (workqueue_t *queue, unsigned int *depth,
+        unsigned long *wait_avg, unsigned long *wait_max)
+{
+    pthread_mutex_lock (&queue->lock);
+    *depth = queue->depth;
+    *wait_avg = queue->started ? (unsigned long)(queue->wait_total / queue->started) : 0;
+    *wait_max = queue->wait_max;
+    queue->started = 0;
+    queue->wait_total = 0;
+    queue->wait_max = 0;
+    pthread_mutex_unlock (&queue->lock);
+}
@@ -0,0 +1,57 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* A small pool of worker threads.
+ *
+ * workers_run_all() hands the same job to every member of the pool at
+ * once, the calling thread taking part as member 0, and returns when
+ * all of them are done.  This is used to split a loop (like the
+ * listener fan-out of a source) into shards which are then processed
+ * in parallel.
+ *
+ * A workqueue is a bounded queue of single jobs which are taken in turn
+ * by a set of threads, for handing off work which may block for a while.
+ */
+
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+typedef struct workers_tag workers_t;
+
+/* job callback, member is in the range 0 .. workers_count()-1 */
+typedef void (*workers_job_t)(void *arg, unsigned int member);
+
+/* create a pool with count members in total, the caller of
+ * workers_run_all() is one of them so count-1 threads are started.
+ */
+workers_t *workers_new(const char *name, unsigned int count);
+void workers_free(workers_t *workers);
+unsigned int workers_count(workers_t *workers);
+
+void workers_run_all(workers_t *workers, workers_job_t job, void *arg);
+
+
+typedef struct workqueue_tag workqueue_t;
+
+typedef void (*workqueue_job_t)(void *arg);
+
+/* start threads taking jobs from a queue of at most limit entries */
+workqueue_t *workqueue_new(const char *name, unsigned int threads, unsigned int limit);
+/* runs what is still queued, then stops the threads */
+void workqueue_free(workqueue_t *queue);
+
+/* returns -1 if the queue is full, the job is not run then */
+int workqueue_add(workqueue_t *queue, workqueue_job_t job, void *arg);
+
+/* number of jobs waiting and the average and longest time in microseconds
+ * the jobs started since the last call had to wait
+ */
+void workqueue_get_stats(workqueue_t *queue, unsigned int *depth,
+        unsigned long *wait_avg, unsigned long *wait_max);
+
+#endif  /* __WORKERS_H__ */
@@ -355,13 +355,9 @@ void xslt_transform(xmlDocPtr doc, const char *xslfilename, client_t *client)
             client_send_error_by_id(client, ICECAST_ERROR_GEN_HEADER_GEN_FAILED);
         } else {
             if ( full_len < (ret + (ssize_t)len + (ssize_t)64) ) {
-                void *new_data;
                 full_len = ret + (ssize_t)len + (ssize_t)64;
-                new_data = realloc(refbuf->data, full_len);
-                if (new_data) {
+                if (refbuf_resize(refbuf, full_len) == 0) {
                     ICECAST_LOG_DEBUG("Client buffer reallocation succeeded.");
-                    refbuf->data = new_data;
-                    refbuf->len = full_len;
                     ret = util_http_build_header(refbuf->data, full_len, 0, 0, 200, NULL, mediatype, charset, NULL, NULL, client);
                     if (ret == -1) {
                         ICECAST_LOG_ERROR("Dropping client as we can not build response headers.");
@@ -0,0 +1,186 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* Feed a chain of ICY blocks the way the mp3 source does and start
+ * listeners on source blocks the way the source queue does, then check
+ * which of them land on the chain and that what they get, before and
+ * after moving on to it, is what the per listener path would have sent.
+ * Output is TAP.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "icychain.h"
+#include "tap.h"
+
+#define SOURCE_BLOCK    1400
+#define SOURCE_BLOCKS   40
+#define INTERVAL        2800
+#define STREAM_SIZE     (SOURCE_BLOCK * SOURCE_BLOCKS)
+
+/* refbuf.c logs and publishes stats, neither is of interest here */
+int errorlog;
+
+void log_write(int log_id, unsigned priority, const char *cat, const char *func,
+        const char *fmt, ...)
+{
+    (void)log_id; (void)priority; (void)cat; (void)func; (void)fmt;
+}
+
+void stats_event_args(const char *source, char *name, char *format, ...)
+{
+    (void)source; (void)name; (void)format;
+}
+
+static unsigned char stream[STREAM_SIZE];
+static refbuf_t *metadata;
+
+/* the stream from start as the per listener path sends it, up to end,
+ * with the metadata after each interval */
+static size_t render(unsigned char *out, size_t start, size_t end)
+{
+    size_t at, len = 0;
+
+    for (at = start; at < end; at++)
+    {
+        out[len++] = stream[at];
+        if ((at + 1 - start) % INTERVAL == 0)
+        {
+            memcpy(out + len, metadata->data, metadata->len);
+            len += metadata->len;
+        }
+    }
+    return len;
+}
+
+/* the chain from block on, as a listener following it gets it */
+static size_t follow(unsigned char *out, refbuf_t *block)
+{
+    size_t len = 0;
+
+    for (; block; block = block->next)
+    {
+        memcpy(out + len, block->data, block->len);
+        len += block->len;
+    }
+    return len;
+}
+
+static refbuf_t *source_block(unsigned int n)
+{
+    refbuf_t *refbuf = refbuf_new(SOURCE_BLOCK);
+
+    memcpy(refbuf->data, stream + (size_t)n * SOURCE_BLOCK, SOURCE_BLOCK);
+    refbuf->associated = metadata;
+    refbuf_addref(metadata);
+    return refbuf;
+}
+
+static void feed(icychain_t *chain, unsigned int from, unsigned int to)
+{
+    unsigned int n;
+
+    for (n = from; n < to; n++)
+    {
+        refbuf_t *refbuf = source_block(n);
+
+        icychain_append(chain, refbuf, 0);
+        refbuf_release(refbuf);
+    }
+}
+
+int main(void)
+{
+    static unsigned char want[STREAM_SIZE * 2], got[STREAM_SIZE * 2];
+    icychain_t chain;
+    refbuf_t *block, *pinned;
+    uint64_t start, offset;
+    unsigned int n, landed = 0, in_phase = 0;
+    size_t len, want_len;
+    uint32_t state = 0x1cecaa57;
+
+    printf("1..10\n");
+    refbuf_initialize();
+    for (len = 0; len < STREAM_SIZE; len++)
+        stream[len] = next_random(&state) & 0xff;
+    metadata = refbuf_new(33);
+    memset(metadata->data, 0, metadata->len);
+    metadata->data[0] = 2;
+    memcpy(metadata->data + 1, "StreamTitle='test';", 19);
+
+    /* the chain starts where the first listener does, on the second block */
+    icychain_init(&chain, INTERVAL, SOURCE_BLOCK);
+    feed(&chain, 1, SOURCE_BLOCKS);
+    want_len = render(want, SOURCE_BLOCK, STREAM_SIZE);
+    len = follow(got, chain.head);
+    check(len == want_len && memcmp(got, want, len) == 0,
+            "chain holds the stream as sent with the metadata");
+
+    /* listeners start on any source block, those whose intervals start
+     * where the blocks of the chain do land on it at once */
+    for (n = 1; n < SOURCE_BLOCKS; n++)
+    {
+        offset = (uint64_t)n * SOURCE_BLOCK;
+        if (icychain_in_phase(&chain, INTERVAL, offset) == 0)
+            continue;
+        in_phase++;
+        block = icychain_block_at(&chain, offset, &start);
+        if (block && start == offset)
+        {
+            want_len = render(want, offset, STREAM_SIZE);
+            len = follow(got, block);
+            if (len == want_len && memcmp(got, want, len) == 0)
+                landed++;
+        }
+    }
+    check(in_phase == SOURCE_BLOCKS / 2, "every other source block is in phase");
+    check(landed == in_phase, "listeners in phase land on the chain with the right stream");
+
+    check(icychain_in_phase(&chain, INTERVAL, 2 * SOURCE_BLOCK) == 0,
+            "listeners out of phase are left to the source queue");
+    check(icychain_in_phase(&chain, INTERVAL / 2, SOURCE_BLOCK) == 0,
+            "listeners with another interval are left to the source queue");
+
+    /* a listener pinning a block keeps it, the ones before it go */
+    block = icychain_block_at(&chain, 5 * SOURCE_BLOCK, &start);
+    refbuf_addref(block);
+    pinned = block;
+    icychain_trim(&chain, 0, STREAM_SIZE);
+    check(chain.head == pinned && chain.offset == 5 * SOURCE_BLOCK,
+            "trimming stops at a block a listener is on");
+    check(icychain_unused(&chain) == 0, "chain with a listener is in use");
+
+    /* a listener in phase starting before the head is sent its own way
+     * up to the first block and follows the chain from there */
+    offset = SOURCE_BLOCK;
+    block = icychain_block_at(&chain, offset, &start);
+    want_len = render(want, offset, STREAM_SIZE);
+    len = render(got, offset, start);
+    len += follow(got + len, block);
+    check(block == pinned && start > offset && (start - offset) % INTERVAL == 0 &&
+            len == want_len && memcmp(got, want, len) == 0,
+            "listener behind the head joins at the next block in phase");
+
+    refbuf_release(pinned);
+    check(icychain_unused(&chain), "chain without listeners is unused");
+
+    icychain_trim(&chain, 0, 0);
+    check(chain.head == chain.tail && chain.lagging,
+            "chain over the limit is lagging");
+
+    icychain_clear(&chain);
+    refbuf_release(metadata);
+    refbuf_shutdown();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* Check the address table used for the allow and deny lists against a
+ * few known cases and a load of random prefixes. With ICECAST_BENCH set a
+ * million prefixes are loaded and it reports how many lookups per second
+ * it manages. Output is TAP.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "iptable.h"
+#include "tap.h"
+
+#define ENTRIES         50000
+#define BENCH_ENTRIES   1000000
+#define LOOKUPS         4000000
+
+static void format_v4(char *buf, size_t len, uint32_t addr, int prefix)
+{
+    snprintf(buf, len, "%u.%u.%u.%u/%d", addr >> 24, (addr >> 16) & 255, (addr >> 8) & 255, addr & 255, prefix);
+}
+
+int main(void)
+{
+    iptable_t *table = iptable_new();
+    uint32_t state = 2463534242U, *probes;
+    char buf[64];
+    clock_t start;
+    double seconds;
+    long i, hits = 0, entries = benchmarking() ? BENCH_ENTRIES : ENTRIES;
+
+    printf("1..16\n");
+
+    check(iptable_add(table, "192.168.1.7") == 0, "add single IPv4 address");
+    check(iptable_add(table, "10.0.0.0/8") == 0, "add IPv4 prefix");
+    check(iptable_add(table, "10.1.0.0/16") == 0, "add overlapping IPv4 prefix");
+    check(iptable_add(table, "2001:db8::/32") == 0, "add IPv6 prefix");
+    check(iptable_add(table, "::ffff:172.16.0.0/108") == 0, "add IPv4 mapped prefix");
+    check(iptable_add(table, "example.com") < 0 && iptable_add(table, "10.0.0.0/33") < 0,
+            "reject names and bad prefixes");
+    check(iptable_compile(table) == 0 && iptable_ranges(table) == 4, "compile merges overlapping ranges");
+
+    check(iptable_match(table, "192.168.1.7") == 1 && iptable_match(table, "192.168.1.8") == 0,
+            "single address matches only itself");
+    check(iptable_match(table, "10.255.255.255") == 1 && iptable_match(table, "11.0.0.0") == 0,
+            "IPv4 prefix bounds");
+    check(iptable_match(table, "2001:db8:ffff::1") == 1 && iptable_match(table, "2001:db9::1") == 0,
+            "IPv6 prefix bounds");
+    check(iptable_match(table, "172.16.3.4") == 1 && iptable_match(table, "172.32.0.0") == 0,
+            "IPv4 mapped prefix matches plain IPv4");
+    check(iptable_match(table, "::ffff:10.2.3.4") == 1, "IPv4 mapped address matches IPv4 prefix");
+    check(iptable_match(table, "not-an-address") < 0, "keys which are no address are reported");
+    iptable_free(table);
+
+    /* a large list of random prefixes between /16 and /32 */
+    table = iptable_new();
+    for (i = 0; i < entries; i++)
+    {
+        uint32_t r = next_random(&state);
+
+        format_v4(buf, sizeof(buf), r, 16 + (int)(next_random(&state) % 17));
+        if (iptable_add(table, buf) < 0)
+            break;
+    }
+    check(i == entries && iptable_compile(table) == 0, "load random prefixes");
+
+    /* every entry must be found again */
+    state = 2463534242U;
+    for (i = 0; i < entries; i++)
+    {
+        uint32_t r = next_random(&state);
+
+        next_random(&state);
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", r >> 24, (r >> 16) & 255, (r >> 8) & 255, r & 255);
+        if (iptable_match(table, buf) != 1)
+            break;
+    }
+    check(i == entries, "all loaded addresses match");
+
+    if (!benchmarking())
+    {
+        skip("random lookups", "set ICECAST_BENCH to time lookups");
+        iptable_free(table);
+        return failed ? 1 : 0;
+    }
+    probes = malloc(sizeof(uint32_t) * 4096);
+    for (i = 0; i < 4096; i++)
+        probes[i] = next_random(&state);
+
+    start = clock();
+    for (i = 0; i < LOOKUPS; i++)
+    {
+        uint32_t r = probes[i & 4095] + (uint32_t)i;
+
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", r >> 24, (r >> 16) & 255, (r >> 8) & 255, r & 255);
+        hits += iptable_match(table, buf);
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    check(hits >= 0, "random lookups");
+    printf("# %lu ranges, %ld lookups in %.2fs, %.0f lookups per second (including formatting), %ld hits\n",
+            (unsigned long)iptable_ranges(table), (long)LOOKUPS, seconds,
+            seconds > 0 ? LOOKUPS / seconds : 0.0, hits);
+
+    free(probes);
+    iptable_free(table);
+    return failed ? 1 : 0;
+}
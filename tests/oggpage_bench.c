@@ -0,0 +1,304 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* Check the native Ogg page framing against libogg, and with
+ * ICECAST_BENCH set compare how fast both page an Opus stream the way the
+ * source ingest does. The stream is a recorded one given on the command
+ * line, or else one made up of 20ms Opus packets, one to a page, as low
+ * delay encoders send them. Output is TAP.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+#include <ogg/ogg.h>
+
+#include "oggpage.h"
+#include "tap.h"
+
+#define STREAM_PAGES        20000
+#define BENCH_STREAM_PAGES  200000
+#define READ_SIZE           4096
+#define BLOCK_SIZE          8192
+#define ROUNDS              5
+
+/* the checksum a bit at a time, as the specification gives it */
+static uint32_t reference_crc(const unsigned char *data, unsigned int len)
+{
+    uint32_t crc = 0;
+    unsigned int i;
+    int bit;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (uint32_t)data[i] << 24;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+    return crc;
+}
+
+/* a single packet page, the checksum is left to libogg */
+static unsigned int make_page(unsigned char *page, const unsigned char *packet, unsigned int len,
+        int bos, uint64_t granule, uint32_t serial, uint32_t sequence)
+{
+    unsigned int segments = len / 255 + 1, i;
+    ogg_page og;
+
+    memcpy(page, "OggS", 4);
+    page[4] = 0;
+    page[5] = bos ? 2 : 0;
+    for (i = 0; i < 8; i++)
+        page[6 + i] = (unsigned char)(granule >> (8 * i));
+    for (i = 0; i < 4; i++)
+    {
+        page[14 + i] = (unsigned char)(serial >> (8 * i));
+        page[18 + i] = (unsigned char)(sequence >> (8 * i));
+    }
+    page[26] = (unsigned char)segments;
+    for (i = 0; i < segments; i++)
+        page[27 + i] = i + 1 < segments ? 255 : len % 255;
+    memcpy(page + 27 + segments, packet, len);
+
+    og.header = page;
+    og.header_len = 27 + segments;
+    og.body = page + og.header_len;
+    og.body_len = len;
+    ogg_page_checksum_set(&og);
+    return og.header_len + len;
+}
+
+static unsigned char *make_stream(unsigned int pages, size_t *size)
+{
+    unsigned char *stream = malloc((size_t)pages * 300 + 4096);
+    unsigned char packet[256];
+    uint32_t state = 2463534242U;
+    size_t pos;
+    unsigned int i;
+
+    memcpy(packet, "OpusHead\001\002\070\001\200\273\000\000\000\000\000", 19);
+    pos = make_page(stream, packet, 19, 1, 0, 0x1ceca57, 0);
+    memcpy(packet, "OpusTags\007\000\000\000icecast\000\000\000\000", 23);
+    pos += make_page(stream + pos, packet, 23, 0, 0, 0x1ceca57, 1);
+    for (i = 2; i < pages; i++)
+    {
+        /* 20ms at 24 to 64kbit/s */
+        unsigned int len = 60 + next_random(&state) % 100, j;
+
+        for (j = 0; j < len; j++)
+            packet[j] = (unsigned char)next_random(&state);
+        pos += make_page(stream + pos, packet, len, 0, (uint64_t)i * 960, 0x1ceca57, i);
+    }
+    *size = pos;
+    return stream;
+}
+
+static unsigned char *load_stream(const char *name, size_t *size)
+{
+    FILE *file = fopen(name, "rb");
+    unsigned char *stream;
+    long len;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) < 0 || (len = ftell(file)) <= 0)
+        return NULL;
+    rewind(file);
+    stream = malloc(len);
+    if (fread(stream, 1, len, file) != (size_t)len)
+    {
+        free(stream);
+        stream = NULL;
+    }
+    fclose(file);
+    *size = len;
+    return stream;
+}
+
+/* as ingest used to: through the sync buffer, then a copy of each page */
+static unsigned long libogg_pages(const unsigned char *stream, size_t size, uint64_t *bytes)
+{
+    ogg_sync_state oy;
+    ogg_page og;
+    unsigned long pages = 0;
+    size_t pos = 0;
+    int ret;
+
+    ogg_sync_init(&oy);
+    *bytes = 0;
+    while (pos < size)
+    {
+        size_t len = size - pos < READ_SIZE ? size - pos : READ_SIZE;
+        char *data = ogg_sync_buffer(&oy, READ_SIZE);
+
+        memcpy(data, stream + pos, len);
+        ogg_sync_wrote(&oy, len);
+        pos += len;
+        while ((ret = ogg_sync_pageout(&oy, &og)) != 0)
+        {
+            unsigned char *copy;
+
+            /* a hole, skipped data */
+            if (ret < 0)
+                continue;
+            copy = malloc(og.header_len + og.body_len);
+            memcpy(copy, og.header, og.header_len);
+            memcpy(copy + og.header_len, og.body, og.body_len);
+            *bytes += og.header_len + og.body_len;
+            free(copy);
+            pages++;
+        }
+    }
+    ogg_sync_clear(&oy);
+    return pages;
+}
+
+/* as ingest does now: pages are found in the read blocks in place, only
+ * a page left over at the end of a block is moved to the next one */
+static unsigned long native_pages(const unsigned char *stream, size_t size, uint64_t *bytes)
+{
+    unsigned char *block = malloc(OGGPAGE_MAX + BLOCK_SIZE);
+    unsigned int count = 0, start = 0, need = 0, block_size = BLOCK_SIZE;
+    unsigned long pages = 0;
+    size_t pos = 0;
+
+    *bytes = 0;
+    while (1)
+    {
+        unsigned int length;
+        int ret;
+
+        if (start < count)
+        {
+            ret = oggpage_check(block + start, count - start, &length);
+            if (ret < 0)
+            {
+                start += length;
+                continue;
+            }
+            if (ret > 0)
+            {
+                *bytes += length;
+                start += length;
+                pages++;
+                continue;
+            }
+            need = length;
+        }
+        if (pos == size)
+            break;
+        if (start + (need ? need : OGGPAGE_HEADER_MIN + 255) > block_size || count == block_size)
+        {
+            block_size = need > BLOCK_SIZE ? need : BLOCK_SIZE;
+            memmove(block, block + start, count - start);
+            count -= start;
+            start = 0;
+        }
+        length = block_size - count < READ_SIZE ? block_size - count : READ_SIZE;
+        if (length > size - pos)
+            length = size - pos;
+        memcpy(block + count, stream + pos, length);
+        count += length;
+        pos += length;
+        need = 0;
+    }
+    free(block);
+    return pages;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned char data[4096];
+    uint32_t state = 88172645U;
+    unsigned char *stream;
+    size_t size;
+    uint64_t libogg_bytes, native_bytes;
+    unsigned long pages, libogg, native;
+    clock_t start;
+    double libogg_time, native_time;
+    unsigned int i;
+    int ok = 1, round;
+
+    printf("1..7\n");
+    oggpage_initialize();
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = (unsigned char)next_random(&state);
+    for (i = 0; i < 200 && ok; i++)
+    {
+        unsigned int offset = next_random(&state) % 64;
+        unsigned int len = next_random(&state) % (sizeof(data) - offset);
+
+        ok = oggpage_crc(0, data + offset, len) == reference_crc(data + offset, len);
+    }
+    check(ok, "slicing-by-8 checksum matches the bitwise one");
+
+    if (argc > 1)
+        stream = load_stream(argv[1], &size);
+    else
+        stream = make_stream(STREAM_PAGES, &size);
+    check(stream != NULL, "stream to page");
+    if (stream == NULL)
+        return 1;
+
+    pages = libogg_pages(stream, size, &libogg_bytes);
+    native = native_pages(stream, size, &native_bytes);
+    check(pages > 0 && native == pages && native_bytes == libogg_bytes, "same pages found as libogg");
+
+    /* damage a page and put junk in between, both have to skip the same */
+    stream[size / 2] ^= 0x55;
+    memcpy(stream + size / 3, "OggSjunk", 8);
+    libogg = libogg_pages(stream, size, &libogg_bytes);
+    native = native_pages(stream, size, &native_bytes);
+    check(libogg < pages && native == libogg && native_bytes == libogg_bytes,
+            "damaged pages are skipped as libogg does");
+    free(stream);
+
+    {
+        unsigned int length;
+        unsigned char page[300];
+        unsigned int len = make_page(page, data, 100, 0, 0, 1, 2);
+
+        check(oggpage_check(page, 20, &length) == 0 && oggpage_check(page, len - 1, &length) == 0 &&
+                length == len && oggpage_check(page, len, &length) == 1 && length == len,
+                "partial pages wait for more data");
+        page[0] = 'X';
+        check(oggpage_check(page, len, &length) < 0 && length > 0, "data without a capture pattern is skipped");
+    }
+
+    if (!benchmarking())
+    {
+        skip("timed runs agree", "set ICECAST_BENCH to time the paging");
+        return failed ? 1 : 0;
+    }
+    if (argc > 1)
+        stream = load_stream(argv[1], &size);
+    else
+        stream = make_stream(BENCH_STREAM_PAGES, &size);
+    if (stream == NULL)
+        return 1;
+    start = clock();
+    for (round = 0; round < ROUNDS; round++)
+        libogg = libogg_pages(stream, size, &libogg_bytes);
+    libogg_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+    for (round = 0; round < ROUNDS; round++)
+        native = native_pages(stream, size, &native_bytes);
+    native_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    check(libogg == native, "timed runs agree");
+    printf("# %lu pages, %lu bytes: libogg %.1f MB/s, native %.1f MB/s\n", native, (unsigned long)size,
+            libogg_time > 0 ? size * ROUNDS / libogg_time / 1e6 : 0.0,
+            native_time > 0 ? size * ROUNDS / native_time / 1e6 : 0.0);
+    free(stream);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* -*- c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/* Hammer the reference counts of a shared queue of buffers from many
+ * threads at once, like listener threads and other mounts would, and
+ * check that no reference is lost or freed twice. Output is TAP.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "refbuf.h"
+
+#define THREADS     8
+#define BLOCKS      64
+#define ROUNDS      20000
+
+/* refbuf.c logs and publishes stats, neither is of interest here */
+int errorlog;
+
+void log_write(int log_id, unsigned priority, const char *cat, const char *func,
+        const char *fmt, ...)
+{
+    (void)log_id; (void)priority; (void)cat; (void)func; (void)fmt;
+}
+
+void stats_event_args(const char *source, char *name, char *format, ...)
+{
+    (void)source; (void)name; (void)format;
+}
+
+static refbuf_t *queue[BLOCKS];
+static refbuf_t *metadata;
+
+static void *hammer(void *arg)
+{
+    unsigned int seed = (unsigned int)(size_t)arg;
+    int round, i;
+
+    for (round = 0; round < ROUNDS; round++)
+    {
+        refbuf_t *held[8];
+        int start = rand_r(&seed) % BLOCKS;
+
+        /* follow the queue for a bit like a listener does */
+        for (i = 0; i < 8; i++)
+        {
+            held[i] = queue[(start + i) % BLOCKS];
+            refbuf_addref(held[i]);
+        }
+        /* short lived buffers which point at the shared ones */
+        for (i = 0; i < 4; i++)
+        {
+            refbuf_t *own = refbuf_new(1400);
+
+            refbuf_addref(metadata);
+            own->associated = metadata;
+            memset(own->data, i, own->len);
+            refbuf_release(own);
+        }
+        for (i = 7; i >= 0; i--)
+            refbuf_release(held[i]);
+    }
+    /* let go of the reference handed over when started */
+    for (i = 0; i < BLOCKS; i++)
+        refbuf_release(queue[i]);
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[THREADS];
+    int i, failed = 0;
+
+    refbuf_initialize();
+    metadata = refbuf_new(64);
+    for (i = 0; i < BLOCKS; i++)
+        queue[i] = refbuf_new(1400);
+
+    printf("1..3\n");
+
+    for (i = 0; i < THREADS; i++)
+    {
+        int b;
+
+        for (b = 0; b < BLOCKS; b++)
+            refbuf_addref(queue[b]);
+        if (pthread_create(&threads[i], NULL, hammer, (void *)(size_t)(i + 1)) != 0)
+        {
+            printf("Bail out! unable to start thread %d\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    printf("ok 1 - %d threads finished\n", THREADS);
+
+    for (i = 0; i < BLOCKS; i++)
+        if (refbuf_count(queue[i]) != 1)
+            failed++;
+    printf("%sok 2 - queue reference counts back to 1\n", failed ? "not " : "");
+
+    printf("%sok 3 - shared metadata reference count back to 1\n",
+            refbuf_count(metadata) == 1 ? "" : "not ");
+
+    for (i = 0; i < BLOCKS; i++)
+        refbuf_release(queue[i]);
+    refbuf_release(metadata);
+    refbuf_shutdown();
+    return 0;
+}
@@ -0,0 +1,52 @@
+/* Icecast
+ *
+ * This program is distributed under the GNU General Public License, version 2.
+ * A copy of this license is included with this source.
+ *
+ * Copyright 2026,      Icecast developers (see AUTHORS for details).
+ */
+
+/* What the test programs share: TAP output and a quick source of random
+ * numbers. The timing runs of the benchmarks only happen when
+ * ICECAST_BENCH is set in the environment, so that make check stays quick.
+ */
+
+#ifndef __TESTS_TAP_H__
+#define __TESTS_TAP_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+static int test_no = 0;
+static int failed = 0;
+
+static inline void check(int ok, const char *what)
+{
+    test_no++;
+    if (!ok)
+        failed++;
+    printf("%sok %d - %s\n", ok ? "" : "not ", test_no, what);
+}
+
+static inline void skip(const char *what, const char *why)
+{
+    test_no++;
+    printf("ok %d - %s # SKIP %s\n", test_no, what, why);
+}
+
+/* xorshift, good enough to spread test data around */
+static inline uint32_t next_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static inline int benchmarking(void)
+{
+    return getenv("ICECAST_BENCH") != NULL;
+}
+
+#endif  /* __TESTS_TAP_H__ */